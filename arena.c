@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+void arena_init(Arena* arena) {
+  arena->first = NULL;
+  arena->current = NULL;
+}
+
+static ArenaBlock* new_block(size_t size) {
+  size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity);
+  if (block == NULL) {
+    printf("Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (arena->current == NULL) {
+    arena->first = new_block(size);
+    arena->current = arena->first;
+  }
+
+  // move on to the next block, reusing blocks kept from earlier statements.
+  while (arena->current->capacity - arena->current->used < size) {
+    if (arena->current->next == NULL) {
+      arena->current->next = new_block(size);
+    }
+    arena->current = arena->current->next;
+    arena->current->used = 0;
+  }
+
+  void* pointer = arena->current->data + arena->current->used;
+  arena->current->used += size;
+  return pointer;
+}
+
+void arena_reset(Arena* arena) {
+  arena->current = arena->first;
+  if (arena->current != NULL) {
+    arena->current->used = 0;
+  }
+}
+
+void arena_free(Arena* arena) {
+  ArenaBlock* block = arena->first;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena_init(arena);
+}
@@ -0,0 +1,30 @@
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+// bump allocator for memory that only lives as long as one statement.
+// blocks are kept across resets, so a steady workload stops calling malloc.
+static const size_t ARENA_BLOCK_SIZE = 1 << 16;
+static const size_t ARENA_ALIGNMENT = 8;
+
+typedef struct ArenaBlock {
+  struct ArenaBlock* next;
+  size_t capacity;
+  size_t used;
+  char data[];
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock* first;
+  // block allocations are currently taken from.
+  ArenaBlock* current;
+} Arena;
+
+void arena_init(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+// release everything allocated since the last reset in one step.
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+#endif
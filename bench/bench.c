@@ -0,0 +1,520 @@
+// benchmark driver for the storage engine.
+// every workload runs against a fresh database file and prints one json object per line.
+//
+// internal nodes cannot split yet, so a run is limited to rows that fit under
+// a single internal root (692 rows in any insert order with 4096 byte pages), and larger -n
+// values are rejected up front. -i repeats a workload
+// on a fresh file to collect enough samples for the tail percentiles.
+//
+// concurrent runs reader threads next to a writer, the only workload that exercises
+// the page latches and scan snapshots from more than one thread.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "vm.h"
+#include "stats.h"
+#include "btree.h"
+#include "arena.h"
+
+typedef struct {
+  const char* filename;
+  uint32_t num_rows;
+  uint32_t iterations;
+  uint32_t seed;
+  // reader threads of the concurrent workload.
+  uint32_t num_readers;
+  CreateOptions options;
+} BenchConfig;
+
+// latencies of every timed operation in a workload.
+typedef struct {
+  uint64_t* samples;
+  size_t num_samples;
+  size_t capacity;
+  uint64_t total_ns;
+  // pager counters accumulated over the measured parts of the workload.
+  Statistics counted;
+  Statistics counting_from;
+} Latencies;
+
+static void add_sample(Latencies* latencies, uint64_t elapsed) {
+  if (latencies->num_samples == latencies->capacity) {
+    latencies->capacity = latencies->capacity ? latencies->capacity * 2 : 1024;
+    latencies->samples = realloc(latencies->samples, latencies->capacity * sizeof(uint64_t));
+  }
+  latencies->samples[latencies->num_samples++] = elapsed;
+  latencies->total_ns += elapsed;
+}
+
+static void record(Latencies* latencies, uint64_t start_ns) {
+  add_sample(latencies, stats_now_ns() - start_ns);
+}
+
+// count pager activity from now until end_counting.
+static void begin_counting(Latencies* latencies) {
+  latencies->counting_from = stats;
+}
+
+static void end_counting(Latencies* latencies) {
+  latencies->counted.cache_hits += stats.cache_hits - latencies->counting_from.cache_hits;
+  latencies->counted.cache_misses += stats.cache_misses - latencies->counting_from.cache_misses;
+  latencies->counted.pages_read += stats.pages_read - latencies->counting_from.pages_read;
+  latencies->counted.pages_written += stats.pages_written - latencies->counting_from.pages_written;
+  latencies->counted.bytes_read += stats.bytes_read - latencies->counting_from.bytes_read;
+  latencies->counted.bytes_written += stats.bytes_written - latencies->counting_from.bytes_written;
+  latencies->counted.fsyncs += stats.fsyncs - latencies->counting_from.fsyncs;
+}
+
+static int compare_uint64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted samples.
+static uint64_t percentile(Latencies* latencies, double p) {
+  if (latencies->num_samples == 0) {
+    return 0;
+  }
+  size_t rank = (size_t)(p * latencies->num_samples + 0.5);
+  if (rank > 0) {
+    rank -= 1;
+  }
+  if (rank >= latencies->num_samples) {
+    rank = latencies->num_samples - 1;
+  }
+  return latencies->samples[rank];
+}
+
+static void report(const char* workload, BenchConfig* config, Latencies* latencies) {
+  qsort(latencies->samples, latencies->num_samples, sizeof(uint64_t), compare_uint64);
+  double seconds = latencies->total_ns / 1e9;
+  printf("{\"workload\":\"%s\",\"rows\":%u,\"iterations\":%u,\"page_size\":%u,\"compressed\":%s,\"leaf_layout\":\"%s\",\"cache_pages\":%d,"
+         "\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+         "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+         "\"cache_hits\":%lu,\"cache_misses\":%lu,\"pages_read\":%lu,\"pages_written\":%lu,"
+         "\"bytes_read\":%lu,\"bytes_written\":%lu,\"fsyncs\":%lu}\n",
+         workload, config->num_rows, config->iterations, config->options.page_size,
+         config->options.compress ? "true" : "false",
+         config->options.leaf_layout == LEAF_LAYOUT_PAX ? "pax" : "row", TABLE_MAX_PAGES,
+         latencies->num_samples, seconds, seconds > 0 ? latencies->num_samples / seconds : 0,
+         percentile(latencies, 0.50), percentile(latencies, 0.99), percentile(latencies, 0.999),
+         latencies->counted.cache_hits, latencies->counted.cache_misses,
+         latencies->counted.pages_read, latencies->counted.pages_written,
+         latencies->counted.bytes_read, latencies->counted.bytes_written, latencies->counted.fsyncs);
+  free(latencies->samples);
+}
+
+// helpers
+
+static Table* open_fresh(BenchConfig* config) {
+  unlink(config->filename);
+  return db_open(config->filename, &config->options);
+}
+
+// scratch memory for each statement, reset once it is done.
+static Arena statement_arena;
+
+static void ignore_row(Row* row, void* context) {
+  *(uint32_t*)context += 1;
+}
+
+static void insert(Table* table, uint32_t key) {
+  Statement statement;
+  statement.type = STATEMENT_INSERT;
+  statement.arena = &statement_arena;
+  statement.row_to_insert.id = key;
+  snprintf(statement.row_to_insert.username, sizeof(statement.row_to_insert.username), "user%u", key);
+  snprintf(statement.row_to_insert.email, sizeof(statement.row_to_insert.email), "person%u@example.com", key);
+  if (execute_statement(&statement, table, ignore_row, NULL) != EXECUTE_SUCCESS) {
+    fprintf(stderr, "insert %u failed\n", key);
+    exit(EXIT_FAILURE);
+  }
+  arena_reset(&statement_arena);
+}
+
+static void lookup(Table* table, uint32_t key) {
+  Row row;
+  if (!find_row(table, key, &row)) {
+    fprintf(stderr, "lookup %u failed\n", key);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// arena must belong to the calling thread.
+static uint32_t scan(Table* table, Arena* arena) {
+  Statement statement;
+  statement.type = STATEMENT_SELECT;
+  statement.arena = arena;
+  uint32_t num_rows = 0;
+  execute_statement(&statement, table, ignore_row, &num_rows);
+  arena_reset(arena);
+  return num_rows;
+}
+
+// keys 1..n in random order.
+static uint32_t* shuffled_keys(uint32_t n) {
+  uint32_t* keys = malloc(n * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    keys[i] = i + 1;
+  }
+  for (uint32_t i = n; i > 1; i--) {
+    uint32_t j = rand() % i;
+    uint32_t key = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = key;
+  }
+  return keys;
+}
+
+// build a database with keys 1..n and reopen it so the cache starts cold.
+static Table* open_populated(BenchConfig* config) {
+  Table* table = open_fresh(config);
+  uint32_t* keys = shuffled_keys(config->num_rows);
+  for (uint32_t i = 0; i < config->num_rows; i++) {
+    insert(table, keys[i]);
+  }
+  free(keys);
+  db_close(table);
+  return db_open(config->filename, &config->options);
+}
+
+// workloads
+
+// inserts count the final flush towards their i/o.
+static void bench_insert(BenchConfig* config, bool sequential) {
+  Latencies latencies = {0};
+  for (uint32_t iteration = 0; iteration < config->iterations; iteration++) {
+    Table* table = open_fresh(config);
+    uint32_t* keys = shuffled_keys(config->num_rows);
+    begin_counting(&latencies);
+    for (uint32_t i = 0; i < config->num_rows; i++) {
+      uint32_t key = sequential ? i + 1 : keys[i];
+      uint64_t start = stats_now_ns();
+      insert(table, key);
+      record(&latencies, start);
+    }
+    db_close(table);
+    end_counting(&latencies);
+    free(keys);
+  }
+  report(sequential ? "sequential_insert" : "random_insert", config, &latencies);
+}
+
+static void bench_point_lookup(BenchConfig* config) {
+  Latencies latencies = {0};
+  for (uint32_t iteration = 0; iteration < config->iterations; iteration++) {
+    Table* table = open_populated(config);
+    uint32_t* keys = shuffled_keys(config->num_rows);
+    begin_counting(&latencies);
+    for (uint32_t i = 0; i < config->num_rows; i++) {
+      uint64_t start = stats_now_ns();
+      lookup(table, keys[i]);
+      record(&latencies, start);
+    }
+    end_counting(&latencies);
+    free(keys);
+    db_close(table);
+  }
+  report("point_lookup", config, &latencies);
+}
+
+static void bench_full_scan(BenchConfig* config) {
+  Latencies latencies = {0};
+  for (uint32_t iteration = 0; iteration < config->iterations; iteration++) {
+    Table* table = open_populated(config);
+    begin_counting(&latencies);
+    uint64_t start = stats_now_ns();
+    uint32_t num_rows = scan(table, &statement_arena);
+    record(&latencies, start);
+    end_counting(&latencies);
+    if (num_rows != config->num_rows) {
+      fprintf(stderr, "scan returned %u rows, expected %u\n", num_rows, config->num_rows);
+      exit(EXIT_FAILURE);
+    }
+    db_close(table);
+  }
+  report("full_scan", config, &latencies);
+}
+
+// half the rows are loaded up front, then each insert of the other half
+// is followed by two lookups, with a full scan every 8 inserts.
+static void bench_mixed(BenchConfig* config) {
+  Latencies latencies = {0};
+  uint32_t preloaded = config->num_rows / 2;
+  for (uint32_t iteration = 0; iteration < config->iterations; iteration++) {
+    Table* table = open_fresh(config);
+    uint32_t* keys = shuffled_keys(config->num_rows);
+    for (uint32_t i = 0; i < preloaded; i++) {
+      insert(table, keys[i]);
+    }
+    begin_counting(&latencies);
+    for (uint32_t i = preloaded; i < config->num_rows; i++) {
+      uint64_t start = stats_now_ns();
+      insert(table, keys[i]);
+      record(&latencies, start);
+      for (uint32_t j = 0; j < 2; j++) {
+        start = stats_now_ns();
+        lookup(table, keys[rand() % (i + 1)]);
+        record(&latencies, start);
+      }
+      if ((i - preloaded) % 8 == 7) {
+        start = stats_now_ns();
+        scan(table, &statement_arena);
+        record(&latencies, start);
+      }
+    }
+    end_counting(&latencies);
+    free(keys);
+    db_close(table);
+  }
+  report("mixed", config, &latencies);
+}
+
+// state shared by the writer and the readers of the concurrent workload.
+typedef struct {
+  Table* table;
+  // keys 1..num_preloaded exist before the readers start.
+  uint32_t num_preloaded;
+  uint32_t num_rows;
+  // set by the writer once every row is inserted.
+  bool writer_done;
+} ConcurrentRun;
+
+typedef struct {
+  ConcurrentRun* run;
+  unsigned int seed;
+  Latencies latencies;
+} Reader;
+
+// rows of a scan must come back in key order.
+typedef struct {
+  uint32_t num_rows;
+  uint32_t last_key;
+  bool ordered;
+} ScanCheck;
+
+static void check_row(Row* row, void* context) {
+  ScanCheck* check = context;
+  if (check->num_rows > 0 && row->id <= check->last_key) {
+    check->ordered = false;
+  }
+  check->last_key = row->id;
+  check->num_rows += 1;
+}
+
+// look up preloaded keys, with a full scan every 8 operations, until the writer is done.
+// every reader does at least num_rows operations in case the writer finishes first.
+static void* run_reader(void* argument) {
+  Reader* reader = argument;
+  ConcurrentRun* run = reader->run;
+  Arena arena;
+  arena_init(&arena);
+
+  for (uint32_t i = 0; i < run->num_rows || !__atomic_load_n(&run->writer_done, __ATOMIC_ACQUIRE); i++) {
+    uint64_t start = stats_now_ns();
+    if (i % 8 == 7) {
+      Statement statement;
+      statement.type = STATEMENT_SELECT;
+      statement.arena = &arena;
+      ScanCheck check = { 0, 0, true };
+      execute_statement(&statement, run->table, check_row, &check);
+      arena_reset(&arena);
+      if (!check.ordered || check.num_rows < run->num_preloaded || check.num_rows > run->num_rows) {
+        fprintf(stderr, "concurrent scan returned %u rows%s\n", check.num_rows, check.ordered ? "" : " out of order");
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      lookup(run->table, rand_r(&reader->seed) % run->num_preloaded + 1);
+    }
+    record(&reader->latencies, start);
+  }
+
+  arena_free(&arena);
+  return NULL;
+}
+
+// half the rows are loaded up front, then one thread inserts the other half
+// while the reader threads run lookups and scans. every operation is a sample,
+// and seconds is wall time so ops_per_sec is the combined rate of all threads.
+static void bench_concurrent(BenchConfig* config) {
+  Latencies latencies = {0};
+  uint32_t preloaded = config->num_rows / 2 > 0 ? config->num_rows / 2 : 1;
+  Reader* readers = calloc(config->num_readers, sizeof(Reader));
+  pthread_t* threads = malloc(config->num_readers * sizeof(pthread_t));
+  uint64_t wall_ns = 0;
+  for (uint32_t iteration = 0; iteration < config->iterations; iteration++) {
+    Table* table = open_fresh(config);
+    for (uint32_t key = 1; key <= preloaded; key++) {
+      insert(table, key);
+    }
+    uint32_t* keys = shuffled_keys(config->num_rows - preloaded);
+
+    ConcurrentRun run = { table, preloaded, config->num_rows, false };
+    begin_counting(&latencies);
+    uint64_t wall_start = stats_now_ns();
+    for (uint32_t i = 0; i < config->num_readers; i++) {
+      memset(&readers[i], 0, sizeof(Reader));
+      readers[i].run = &run;
+      readers[i].seed = config->seed + iteration * config->num_readers + i;
+      pthread_create(&threads[i], NULL, run_reader, &readers[i]);
+    }
+    for (uint32_t i = 0; i < config->num_rows - preloaded; i++) {
+      uint64_t start = stats_now_ns();
+      insert(table, preloaded + keys[i]);
+      record(&latencies, start);
+    }
+    __atomic_store_n(&run.writer_done, true, __ATOMIC_RELEASE);
+
+    for (uint32_t i = 0; i < config->num_readers; i++) {
+      pthread_join(threads[i], NULL);
+      Latencies* reader_latencies = &readers[i].latencies;
+      for (size_t j = 0; j < reader_latencies->num_samples; j++) {
+        add_sample(&latencies, reader_latencies->samples[j]);
+      }
+      free(reader_latencies->samples);
+    }
+    wall_ns += stats_now_ns() - wall_start;
+    end_counting(&latencies);
+
+    if (scan(table, &statement_arena) != config->num_rows) {
+      fprintf(stderr, "concurrent inserts lost rows\n");
+      exit(EXIT_FAILURE);
+    }
+    free(keys);
+    db_close(table);
+  }
+  free(threads);
+  free(readers);
+  latencies.total_ns = wall_ns;
+  report("concurrent", config, &latencies);
+}
+
+typedef struct {
+  const char* name;
+  void (*run)(BenchConfig* config);
+} Workload;
+
+static void bench_sequential_insert(BenchConfig* config) {
+  bench_insert(config, true);
+}
+
+static void bench_random_insert(BenchConfig* config) {
+  bench_insert(config, false);
+}
+
+static const Workload WORKLOADS[] = {
+  { "sequential_insert", bench_sequential_insert },
+  { "random_insert", bench_random_insert },
+  { "point_lookup", bench_point_lookup },
+  { "full_scan", bench_full_scan },
+  { "mixed", bench_mixed },
+  { "concurrent", bench_concurrent },
+};
+static const size_t NUM_WORKLOADS = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+
+// most rows every workload can insert in any order: the root internal node holds
+// as many leaves as it has children and the pager has pages (minus the header and the root),
+// every leaf but the full one holds at least the smaller half of a split.
+static uint32_t max_rows(uint32_t page_size) {
+  uint32_t max_cells = leaf_node_max_cells(page_size);
+  uint32_t left = leaf_node_left_split_count(page_size);
+  uint32_t right = leaf_node_right_split_count(page_size);
+  uint32_t max_leaves = internal_node_max_cells(page_size) + 1;
+  if (max_leaves > TABLE_MAX_PAGES - 2) {
+    max_leaves = TABLE_MAX_PAGES - 2;
+  }
+  return (left < right ? left : right) * (max_leaves - 1) + max_cells;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s [-n rows] [-i iterations] [-s seed] [-p page size] [-z] [-x] [-r readers] [-f file] [workload...]\n", program);
+  fprintf(stderr, "workloads:");
+  for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+    fprintf(stderr, " %s", WORKLOADS[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+static const Workload* find_workload(const char* name) {
+  for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+    if (strcmp(WORKLOADS[i].name, name) == 0) {
+      return &WORKLOADS[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+  BenchConfig config = { "bench.db", 20, 200, 1, 4, { DEFAULT_PAGE_SIZE, false, LEAF_LAYOUT_ROW } };
+
+  int option;
+  while ((option = getopt(argc, argv, "n:i:s:p:zxr:f:")) != -1) {
+    switch (option) {
+      case 'n':
+        config.num_rows = atoi(optarg);
+        break;
+      case 'i':
+        config.iterations = atoi(optarg);
+        break;
+      case 's':
+        config.seed = atoi(optarg);
+        break;
+      case 'p':
+        config.options.page_size = atoi(optarg);
+        break;
+      case 'r':
+        config.num_readers = atoi(optarg);
+        break;
+      case 'x':
+        config.options.leaf_layout = LEAF_LAYOUT_PAX;
+        break;
+      case 'z':
+        config.options.compress = true;
+        break;
+      case 'f':
+        config.filename = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (config.num_rows == 0 || config.iterations == 0 || config.num_readers == 0) {
+    usage(argv[0]);
+  }
+  if (config.num_rows > max_rows(config.options.page_size)) {
+    fprintf(stderr, "-n %u is more rows than the tree can hold with %u byte pages (at most %u).\n",
+        config.num_rows, config.options.page_size, max_rows(config.options.page_size));
+    usage(argv[0]);
+  }
+  for (int i = optind; i < argc; i++) {
+    if (find_workload(argv[i]) == NULL) {
+      usage(argv[0]);
+    }
+  }
+  srand(config.seed);
+  arena_init(&statement_arena);
+
+  // with no workload named, run all of them.
+  if (optind == argc) {
+    for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+      WORKLOADS[i].run(&config);
+    }
+  } else {
+    for (int i = optind; i < argc; i++) {
+      find_workload(argv[i])->run(&config);
+    }
+  }
+
+  arena_free(&statement_arena);
+  unlink(config.filename);
+  return 0;
+}
@@ -4,21 +4,114 @@
 #include "btree.h"
 #include "pager.h"
 
+// node capacity
+
+uint32_t leaf_node_space_for_cells(uint32_t page_size) {
+    return page_size - LEAF_NODE_HEADER_SIZE;
+}
+
+uint32_t leaf_node_max_cells(uint32_t page_size) {
+    return leaf_node_space_for_cells(page_size) / LEAF_NODE_CELL_SIZE;
+}
+
+uint32_t leaf_node_right_split_count(uint32_t page_size) {
+    return (leaf_node_max_cells(page_size) + 1) / 2;
+}
+
+uint32_t leaf_node_left_split_count(uint32_t page_size) {
+    return leaf_node_max_cells(page_size) + 1 - leaf_node_right_split_count(page_size);
+}
+
+uint32_t internal_node_max_cells(uint32_t page_size) {
+    return (page_size - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
+}
+
 // accessing leaf node fields
 uint32_t* leaf_node_num_cells(void* node) {
     return node + LEAF_NODE_NUM_CELLS_OFFSET;
 }
 
-void* leaf_node_cell(void* node, uint32_t cell_num) {
+LeafLayout get_leaf_layout(void* node) {
+    uint8_t node_type = *(uint8_t*)(node + NODE_TYPE_OFFSET);
+    return (node_type & LEAF_NODE_PAX_FLAG) ? LEAF_LAYOUT_PAX : LEAF_LAYOUT_ROW;
+}
+
+static uint32_t* leaf_node_column_capacity(void* node) {
+    return node + LEAF_NODE_COLUMN_CAPACITY_OFFSET;
+}
+
+// row layout
+
+static void* leaf_node_cell(void* node, uint32_t cell_num) {
     return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
 }
 
+static void* leaf_node_value(void* node, uint32_t cell_num) {
+    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+}
+
+// pax layout
+
+static void* leaf_node_keys_column(void* node) {
+    return node + LEAF_NODE_PAX_HEADER_SIZE;
+}
+
+static void* leaf_node_usernames_column(void* node) {
+    return leaf_node_keys_column(node) + *leaf_node_column_capacity(node) * LEAF_NODE_KEY_SIZE;
+}
+
+static void* leaf_node_emails_column(void* node) {
+    return leaf_node_usernames_column(node) + *leaf_node_column_capacity(node) * USERNAME_SIZE;
+}
+
 uint32_t* leaf_node_key(void* node, uint32_t cell_num) {
+    if (get_leaf_layout(node) == LEAF_LAYOUT_PAX) {
+        return leaf_node_keys_column(node) + cell_num * LEAF_NODE_KEY_SIZE;
+    }
     return leaf_node_cell(node, cell_num);
 }
 
-void* leaf_node_value(void* node, uint32_t cell_num) {
-    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+uint32_t* leaf_node_id(void* node, uint32_t cell_num) {
+    if (get_leaf_layout(node) == LEAF_LAYOUT_PAX) {
+        return leaf_node_key(node, cell_num);
+    }
+    return leaf_node_value(node, cell_num) + ID_OFFSET;
+}
+
+char* leaf_node_username(void* node, uint32_t cell_num) {
+    if (get_leaf_layout(node) == LEAF_LAYOUT_PAX) {
+        return leaf_node_usernames_column(node) + cell_num * USERNAME_SIZE;
+    }
+    return leaf_node_value(node, cell_num) + USERNAME_OFFSET;
+}
+
+char* leaf_node_email(void* node, uint32_t cell_num) {
+    if (get_leaf_layout(node) == LEAF_LAYOUT_PAX) {
+        return leaf_node_emails_column(node) + cell_num * EMAIL_SIZE;
+    }
+    return leaf_node_value(node, cell_num) + EMAIL_OFFSET;
+}
+
+void leaf_node_copy_cell(void* destination_node, uint32_t destination_cell_num, void* source_node, uint32_t source_cell_num) {
+    if (get_leaf_layout(destination_node) == LEAF_LAYOUT_ROW && get_leaf_layout(source_node) == LEAF_LAYOUT_ROW) {
+        memcpy(leaf_node_cell(destination_node, destination_cell_num), leaf_node_cell(source_node, source_cell_num), LEAF_NODE_CELL_SIZE);
+        return;
+    }
+    *leaf_node_key(destination_node, destination_cell_num) = *leaf_node_key(source_node, source_cell_num);
+    *leaf_node_id(destination_node, destination_cell_num) = *leaf_node_id(source_node, source_cell_num);
+    memcpy(leaf_node_username(destination_node, destination_cell_num), leaf_node_username(source_node, source_cell_num), USERNAME_SIZE);
+    memcpy(leaf_node_email(destination_node, destination_cell_num), leaf_node_email(source_node, source_cell_num), EMAIL_SIZE);
+}
+
+void leaf_node_shift_cells(void* node, uint32_t cell_num) {
+    uint32_t num_cells_to_move = *leaf_node_num_cells(node) - cell_num;
+    if (get_leaf_layout(node) == LEAF_LAYOUT_PAX) {
+        memmove(leaf_node_key(node, cell_num + 1), leaf_node_key(node, cell_num), num_cells_to_move * LEAF_NODE_KEY_SIZE);
+        memmove(leaf_node_username(node, cell_num + 1), leaf_node_username(node, cell_num), num_cells_to_move * USERNAME_SIZE);
+        memmove(leaf_node_email(node, cell_num + 1), leaf_node_email(node, cell_num), num_cells_to_move * EMAIL_SIZE);
+    } else {
+        memmove(leaf_node_cell(node, cell_num + 1), leaf_node_cell(node, cell_num), num_cells_to_move * LEAF_NODE_CELL_SIZE);
+    }
 }
 
 static void set_node_type(void* node, NodeType type) {
@@ -31,15 +124,19 @@ void set_node_root(void* node, bool is_root) {
     *(uint8_t*)(node + IS_ROOT_OFFSET) = value;
 }
 
-void initialize_leaf_node(void* node) {
+void initialize_leaf_node(void* node, LeafLayout layout, uint32_t page_size) {
     set_node_type(node, NODE_LEAF);
     set_node_root(node, false);
     *leaf_node_num_cells(node) = 0;
+    if (layout == LEAF_LAYOUT_PAX) {
+        *(uint8_t*)(node + NODE_TYPE_OFFSET) |= LEAF_NODE_PAX_FLAG;
+        *leaf_node_column_capacity(node) = leaf_node_max_cells(page_size);
+    }
 }
 
 NodeType get_node_type(void* node) {
     uint8_t node_type = *(uint8_t*)(node + NODE_TYPE_OFFSET);
-    return (NodeType)node_type;
+    return (NodeType)(node_type & NODE_TYPE_MASK);
 } 
 
 uint32_t* internal_node_num_keys(void* node) {
@@ -67,7 +164,8 @@ uint32_t* internal_node_child(void* node, uint32_t child_num) {
 }
 
 uint32_t* internal_node_key(void* node, uint32_t key_num) {
-    return internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
+    // offsets are in bytes, not in uint32_t steps.
+    return (void*)internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
 }
 
 uint32_t get_node_max_key(void* node) {
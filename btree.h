@@ -20,6 +20,9 @@ static const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
 static const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
 static const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
 static const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+// set in the node type byte of pax leaves.
+static const uint8_t NODE_TYPE_MASK = 0x7f;
+static const uint8_t LEAF_NODE_PAX_FLAG = 0x80;
 
 // leaf node header contains how many cells they contain.
 
@@ -35,11 +38,14 @@ static const uint32_t LEAF_NODE_KEY_OFFSET = 0;
 static const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
 static const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
 static const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-static const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-static const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
-// split
-static const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1)  / 2;
-static const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = LEAF_NODE_MAX_CELLS + 1 - LEAF_NODE_RIGHT_SPLIT_COUNT;
+
+// a pax leaf body holds all keys, then all usernames, then all emails.
+// the key doubles as the row id, so a pax cell is smaller than a row cell
+// and a pax leaf always fits as many cells as a row leaf of the same page size.
+// the header records how many cells each column has room for.
+static const uint32_t LEAF_NODE_COLUMN_CAPACITY_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_COLUMN_CAPACITY_OFFSET = LEAF_NODE_HEADER_SIZE;
+static const uint32_t LEAF_NODE_PAX_HEADER_SIZE = LEAF_NODE_HEADER_SIZE + LEAF_NODE_COLUMN_CAPACITY_SIZE;
 
 // internal node header
 // common header, number of keys, page number of rightmost child.
@@ -54,11 +60,25 @@ static const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 static const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 static const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE;
 
+// node capacity depends on the page size of the database.
+uint32_t leaf_node_space_for_cells(uint32_t page_size);
+uint32_t leaf_node_max_cells(uint32_t page_size);
+// split
+uint32_t leaf_node_right_split_count(uint32_t page_size);
+uint32_t leaf_node_left_split_count(uint32_t page_size);
+uint32_t internal_node_max_cells(uint32_t page_size);
+
 uint32_t* leaf_node_num_cells(void* node);
-void initialize_leaf_node(void* node);
+void initialize_leaf_node(void* node, LeafLayout layout, uint32_t page_size);
+LeafLayout get_leaf_layout(void* node);
 uint32_t* leaf_node_key(void* node, uint32_t cell_num);
-void* leaf_node_value(void* node, uint32_t cell_num);
-void* leaf_node_cell(void* node, uint32_t cell_num);
+// fields of the row stored in a cell, in either layout.
+uint32_t* leaf_node_id(void* node, uint32_t cell_num);
+char* leaf_node_username(void* node, uint32_t cell_num);
+char* leaf_node_email(void* node, uint32_t cell_num);
+void leaf_node_copy_cell(void* destination_node, uint32_t destination_cell_num, void* source_node, uint32_t source_cell_num);
+// move cells from cell_num on one place to the right.
+void leaf_node_shift_cells(void* node, uint32_t cell_num);
 NodeType get_node_type(void* node);
 uint32_t* internal_node_num_keys(void* node);
 uint32_t* internal_node_child(void* node, uint32_t child_num);
@@ -4,8 +4,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 
+#ifndef TABLE_MAX_PAGES
 #define TABLE_MAX_PAGES 100
+#endif
+// deepest tree a cursor can crab through.
+#define CURSOR_MAX_DEPTH 8
 
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
@@ -20,12 +25,62 @@ typedef enum {
   EXECUTE_SUCCESS, EXECUTE_TABLE_FULL, EXECUTE_DUPLICATE_KEY
 } ExecuteResult;
 
+// reader/writer latch modes for buffer frames.
+typedef enum {
+  LATCH_NONE, LATCH_SHARED, LATCH_EXCLUSIVE
+} LatchMode;
+
 typedef struct {
   char* buffer;
   size_t buffer_length;
   size_t input_length;
 } InputBuffer;
 
+// first page of the database file.
+// describes the file so it can be opened without scanning it.
+#define DB_HEADER_VERSION 1
+#define SCHEMA_SIZE 512
+
+typedef struct {
+  char magic[16];
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t root_page_num;
+  uint32_t num_pages;
+  // first page of the freelist, 0 when no page is free.
+  uint32_t freelist_head;
+  uint64_t num_rows;
+  // schema catalog: the definition of every table in the file.
+  char schema[SCHEMA_SIZE];
+  // fields below were added after version 1 shipped and read as zero in older files.
+  uint32_t flags;
+} DatabaseHeader;
+
+// pages are stored compressed, see compression.h.
+#define DB_FLAG_COMPRESSED 0x1
+// new leaves use the pax layout, see btree.h.
+#define DB_FLAG_PAX_LEAVES 0x2
+
+// where a page of a compressed database is stored.
+// pages are rewritten in place while they fit their extent, and appended otherwise.
+// a length of 0 means the page was never written.
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+  uint32_t capacity;
+} PageExtent;
+
+// leaves come in two layouts, chosen when the database is created.
+// row leaves store each cell contiguously, pax leaves store each field as a mini column.
+typedef enum { LEAF_LAYOUT_ROW, LEAF_LAYOUT_PAX } LeafLayout;
+
+// options that only take effect when a database file is created.
+typedef struct {
+  uint32_t page_size;
+  bool compress;
+  LeafLayout leaf_layout;
+} CreateOptions;
+
 typedef struct {
   uint32_t id;
   char username[COLUMN_USERNAME_SIZE + 1];
@@ -36,26 +91,53 @@ typedef struct {
 // pager accesses page cache and file. 
 // table makes requests for pages through the pager.
 typedef struct {
+  char* filename;
   int file_descriptor;
   uint32_t file_length;
+  uint32_t page_size;
   uint32_t num_pages;
+  // in memory copy of page 0, written back when the pager is flushed.
+  DatabaseHeader header;
+  // page map of a compressed database, stored in page 0 after the header.
+  PageExtent extents[TABLE_MAX_PAGES];
+  // scratch space for compressing and decompressing pages.
+  void* compression_buffer;
+  // one frame per cache slot, allocated once when the pager is opened.
+  void* frames;
   void* pages[TABLE_MAX_PAGES];
+  // guards cache misses and num_pages. hits only load the slot atomically.
+  pthread_mutex_t lock;
+  // one reader/writer latch per buffer frame.
+  pthread_rwlock_t latches[TABLE_MAX_PAGES];
 }  Pager;
 
 // table keeps track of its root node page number.
+// any number of readers may run concurrently with a single writer.
 typedef struct {
   Pager* pager;
   uint32_t root_page_num;
+  // serializes writers. readers only take page latches.
+  pthread_mutex_t writer_lock;
+  // print per-statement latency (.timer on).
+  bool timer;
 } Table;
 
 // represents location in the table.
 // provides abstraction for how table is stored.
+// cursors are owned by the caller, usually on the stack, and never allocated.
 // we identity a position by page number of the node, and the cell number within the node.
 typedef struct {
     Table* table;
     uint32_t page_num;
     uint32_t cell_num;
     bool end_of_table;
+    // pages latched while crabbing down the tree, root first.
+    LatchMode latch_mode;
+    uint32_t latched_pages[CURSOR_MAX_DEPTH];
+    uint32_t num_latched;
+    // read-only copy of the leaf a scan is on, taken under its shared latch.
+    // the copy lives in the statement's arena.
+    void* snapshot;
 } Cursor;
 
 static const uint32_t ID_SIZE = size_of_attribute(Row, id);
@@ -65,12 +147,16 @@ static const uint32_t ID_OFFSET = 0;
 static const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
 static const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
 
-static const uint32_t PAGE_SIZE = 4096;
-
 static const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
 
-static const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
-static const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES;
+// page size is chosen when the database is created and read back from its header.
+static const uint32_t DEFAULT_PAGE_SIZE = 4096;
+static const uint32_t MIN_PAGE_SIZE = 4096;
+static const uint32_t MAX_PAGE_SIZE = 65536;
+
+static const char DB_HEADER_MAGIC[16] = "sqlite-clone db";
+static const char DB_SCHEMA[] =
+    "CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(32), email VARCHAR(255));";
 
 
 #endif
\ No newline at end of file
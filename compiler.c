@@ -6,10 +6,12 @@
 static PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
   statement->type = STATEMENT_INSERT;
 
-  char* keyword = strtok(input_buffer->buffer, " ");
-  char* id_string = strtok(NULL, " ");
-  char* username = strtok(NULL, " ");
-  char* email = strtok(NULL, " ");
+  // strtok_r keeps parsing safe when statements are prepared on several threads.
+  char* save_pointer;
+  char* keyword = strtok_r(input_buffer->buffer, " ", &save_pointer);
+  char* id_string = strtok_r(NULL, " ", &save_pointer);
+  char* username = strtok_r(NULL, " ", &save_pointer);
+  char* email = strtok_r(NULL, " ", &save_pointer);
 
   if (id_string == NULL || username == NULL || email == NULL) {
     return PREPARE_SYNTAX_ERROR;
@@ -3,12 +3,15 @@
 
 #include <stdint.h>
 #include "common.h"
+#include "arena.h"
 
 typedef enum { STATEMENT_INSERT, STATEMENT_SELECT } StatementType;
 
 typedef struct {
   StatementType type;
   Row row_to_insert;
+  // scratch memory for parsing and executing, reset by the caller once the statement is done.
+  Arena* arena;
 } Statement;
 
 PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement);
@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include "compression.h"
+
+uint32_t compress_bound(uint32_t size) {
+  // one literal token per COMPRESSION_MAX_LITERAL bytes.
+  return size + (size + COMPRESSION_MAX_LITERAL - 1) / COMPRESSION_MAX_LITERAL;
+}
+
+// length of the run of equal bytes starting at source[i].
+static uint32_t run_length(const uint8_t* source, uint32_t i, uint32_t size) {
+  uint32_t length = 1;
+  while (i + length < size && length < COMPRESSION_MAX_RUN && source[i + length] == source[i]) {
+    length++;
+  }
+  return length;
+}
+
+static uint32_t emit_literal(const uint8_t* literal, uint32_t length, uint8_t* destination) {
+  destination[0] = length - 1;
+  memcpy(destination + 1, literal, length);
+  return length + 1;
+}
+
+uint32_t compress_page(const uint8_t* source, uint32_t size, uint8_t* destination) {
+  uint32_t output = 0;
+  uint32_t literal_start = 0;
+  uint32_t i = 0;
+
+  while (i < size) {
+    uint32_t length = run_length(source, i, size);
+    if (length < COMPRESSION_MIN_RUN) {
+      i += length;
+      continue;
+    }
+
+    // flush pending literals in chunks, then the run.
+    while (literal_start < i) {
+      uint32_t literal_length = i - literal_start;
+      if (literal_length > COMPRESSION_MAX_LITERAL) {
+        literal_length = COMPRESSION_MAX_LITERAL;
+      }
+      output += emit_literal(source + literal_start, literal_length, destination + output);
+      literal_start += literal_length;
+    }
+    destination[output++] = 0x80 | (length >> 8);
+    destination[output++] = length & 0xff;
+    destination[output++] = source[i];
+    i += length;
+    literal_start = i;
+  }
+
+  while (literal_start < size) {
+    uint32_t literal_length = size - literal_start;
+    if (literal_length > COMPRESSION_MAX_LITERAL) {
+      literal_length = COMPRESSION_MAX_LITERAL;
+    }
+    output += emit_literal(source + literal_start, literal_length, destination + output);
+    literal_start += literal_length;
+  }
+
+  return output;
+}
+
+bool decompress_page(const uint8_t* source, uint32_t length, uint8_t* destination, uint32_t size) {
+  uint32_t input = 0;
+  uint32_t output = 0;
+
+  while (input < length) {
+    uint8_t token = source[input++];
+    if (token < 0x80) {
+      uint32_t literal_length = token + 1;
+      if (input + literal_length > length || output + literal_length > size) {
+        return false;
+      }
+      memcpy(destination + output, source + input, literal_length);
+      input += literal_length;
+      output += literal_length;
+    } else {
+      if (input + 2 > length) {
+        return false;
+      }
+      uint32_t run = ((token & 0x7f) << 8) | source[input];
+      if (output + run > size) {
+        return false;
+      }
+      memset(destination + output, source[input + 1], run);
+      input += 2;
+      output += run;
+    }
+  }
+
+  return output == size;
+}
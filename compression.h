@@ -0,0 +1,25 @@
+#ifndef compression_h
+#define compression_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// page codec for compressed databases.
+// a compressed page is a sequence of tokens:
+//   0x00-0x7f  literal: the next (token + 1) bytes are copied as is.
+//   0x80-0xff  run: a second length byte follows, then the byte to repeat
+//              ((token & 0x7f) << 8 | length) times.
+// fixed-width rows are mostly zero padding, which collapses into runs.
+
+static const uint32_t COMPRESSION_MAX_LITERAL = 128;
+static const uint32_t COMPRESSION_MIN_RUN = 4;
+static const uint32_t COMPRESSION_MAX_RUN = 0x7fff;
+
+// largest possible output for size bytes of input.
+uint32_t compress_bound(uint32_t size);
+// returns the compressed length.
+uint32_t compress_page(const uint8_t* source, uint32_t size, uint8_t* destination);
+// returns false if the input is malformed or does not expand to exactly size bytes.
+bool decompress_page(const uint8_t* source, uint32_t length, uint8_t* destination, uint32_t size);
+
+#endif
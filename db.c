@@ -1,26 +1,28 @@
 #include <stdlib.h>
+#include <errno.h>
+#include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "compiler.h"
 #include "vm.h"
 #include "pager.h"
 #include "btree.h"
+#include "server.h"
+#include "stats.h"
+#include "arena.h"
+
+#define SCRIPT_READ_SIZE (1 << 16)
+#define SCRIPT_OUTPUT_BUFFER_SIZE (1 << 16)
 
 void print_prompt() {
   printf("db > ");
 }
 
-InputBuffer* new_input_buffer() {
-  InputBuffer* input_buffer = (InputBuffer*)malloc(sizeof(InputBuffer));
-  input_buffer->buffer = NULL;
-  input_buffer->buffer_length = 0;
-  input_buffer->input_length = 0;
-  
-  return input_buffer;
-}
-
 void read_input(InputBuffer* input_buffer) {
   ssize_t bytes_read = getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
 
@@ -33,29 +35,148 @@ void read_input(InputBuffer* input_buffer) {
   input_buffer->buffer[bytes_read - 1] = 0;
 }
 
-void close_input_buffer(InputBuffer* input_buffer) {
-  free(input_buffer->buffer);
-  free(input_buffer);
+// scratch memory for the statement being run, reset once it is done.
+static Arena statement_arena;
+
+// run one statement or meta command and print its outcome.
+static void run_statement(InputBuffer* input_buffer, Table* table) {
+  if (input_buffer->buffer[0] == '.') {
+    switch (do_meta_command(input_buffer, table)) {
+      case (META_COMMAND_SUCCESS):
+        return;
+      case (META_COMMAND_UNRECOGNIZED_COMMAND):
+        printf("Unrecognized command: %s\n", input_buffer->buffer);
+        return;
+    }
+  }
+
+  Statement statement;
+  statement.arena = &statement_arena;
+  uint64_t start_ns = stats_now_ns();
+  PrepareResult prepare_result = prepare_statement(input_buffer, &statement);
+  uint64_t prepared_ns = stats_now_ns();
+  stats_add(prepare_ns, prepared_ns - start_ns);
+
+  switch (prepare_result) {
+    case (PREPARE_SUCCESS):
+      break;
+    case (PREPARE_STRING_TOO_LONG):
+      printf("String is too long.\n");
+      return;
+    case (PREPARE_SYNTAX_ERROR): 
+      printf("Syntax error. Could not parse statement.\n");
+      return;
+    case (PREPARE_UNRECOGNIZED_STATEMENT):
+      printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
+      return;
+  }
+
+  ExecuteResult execute_result = execute_statement(&statement, table, print_row, NULL);
+  arena_reset(&statement_arena);
+  uint64_t executed_ns = stats_now_ns();
+  stats_add(execute_ns, executed_ns - prepared_ns);
+  stats_add(statements, 1);
+
+  switch (execute_result) {
+    case (EXECUTE_SUCCESS):
+      printf("Executed.\n");
+      break;
+    case (EXECUTE_DUPLICATE_KEY):
+      printf("Error: Duplicate key.\n");
+      break;
+    case (EXECUTE_TABLE_FULL):
+      printf("Error: Table full.\n");
+      break;
+  }
+  if (table->timer) {
+    printf("Run Time: prepare %lu ns, execute %lu ns\n", prepared_ns - start_ns, executed_ns - prepared_ns);
+  }
+}
+
+// batch mode
+
+// run one line of a script. the line is terminated in place, nothing is copied.
+static void run_script_line(char* line, size_t line_length, Table* table) {
+  if (line_length > 0 && line[line_length - 1] == '\r') {
+    line_length -= 1;
+  }
+  if (line_length == 0) {
+    return;
+  }
+  line[line_length] = 0;
+  InputBuffer input_buffer = { line, line_length + 1, line_length };
+  run_statement(&input_buffer, table);
 }
 
-// open a connection to the database.
-Table* db_open(const char* filename) {
-  // open database file
-  // initialize pager data structure
-  Pager* pager = pager_open(filename);
-  // initialize table data structure
-  Table* table = (Table*)malloc(sizeof(Table));
-  table->pager = pager;
-  table->root_page_num = 0;
-
-  if (pager->num_pages == 0) {
-    // intialize root page as leaf node.
-    void* root_node = get_page(pager, 0);
-    initialize_leaf_node(root_node);
-    set_node_root(root_node, true);
+// run every complete line in buffer. returns the number of bytes consumed.
+static size_t run_script_lines(char* buffer, size_t length, Table* table) {
+  char* start = buffer;
+  char* end = buffer + length;
+  char* newline;
+  while ((newline = memchr(start, '\n', end - start)) != NULL) {
+    run_script_line(start, newline - start, table);
+    start = newline + 1;
+  }
+  return start - buffer;
+}
+
+// run a script from fd without prompts, with stdout fully buffered.
+// regular files are mapped and split in place, anything else is streamed in large reads.
+static void run_script(int fd, Table* table) {
+  setvbuf(stdout, NULL, _IOFBF, SCRIPT_OUTPUT_BUFFER_SIZE);
+
+  struct stat script_stat;
+  if (fstat(fd, &script_stat) == 0 && S_ISREG(script_stat.st_mode) && script_stat.st_size > 0) {
+    size_t length = script_stat.st_size;
+    // a private writable mapping lets lines be terminated without touching the file.
+    char* script = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (script == MAP_FAILED) {
+      printf("Error mapping script: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+    madvise(script, length, MADV_SEQUENTIAL);
+
+    size_t consumed = run_script_lines(script, length, table);
+    if (consumed < length) {
+      // the last line has no newline and no room for a terminator.
+      size_t line_length = length - consumed;
+      char* line = malloc(line_length + 1);
+      memcpy(line, script + consumed, line_length);
+      run_script_line(line, line_length, table);
+      free(line);
+    }
+    munmap(script, length);
+    return;
   }
 
-  return table;
+  size_t capacity = SCRIPT_READ_SIZE;
+  size_t length = 0;
+  char* buffer = malloc(capacity + 1);
+  while (true) {
+    if (capacity - length < SCRIPT_READ_SIZE / 2) {
+      // a single line longer than the buffer.
+      capacity *= 2;
+      buffer = realloc(buffer, capacity + 1);
+    }
+    ssize_t bytes_read = read(fd, buffer + length, capacity - length);
+    if (bytes_read == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("Error reading input\n");
+      exit(EXIT_FAILURE);
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    length += bytes_read;
+    size_t consumed = run_script_lines(buffer, length, table);
+    length -= consumed;
+    memmove(buffer, buffer + consumed, length);
+  }
+  // the buffer keeps a spare byte for terminating a last line without newline.
+  run_script_line(buffer, length, table);
+  free(buffer);
 }
 
 int main(int argc, char* argv[]) {
@@ -65,48 +186,66 @@ int main(int argc, char* argv[]) {
   }
 
   char* filename = argv[1];
-  Table* table = db_open(filename);
+  char* socket_path = NULL;
+  char* script_filename = NULL;
+  bool interactive = false;
+  CreateOptions options = { DEFAULT_PAGE_SIZE, false, LEAF_LAYOUT_ROW };
 
-  InputBuffer* input_buffer = new_input_buffer();
-  while (true) {
-    print_prompt();
-    read_input(input_buffer);
-
-    if (input_buffer->buffer[0] == '.') {
-      switch (do_meta_command(input_buffer, table)) {
-        case (META_COMMAND_SUCCESS):
-          continue;
-        case (META_COMMAND_UNRECOGNIZED_COMMAND):
-          printf("Unrecognized command: %s\n", input_buffer->buffer);
-          continue;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+      options.page_size = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--leaf-layout") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "pax") == 0) {
+        options.leaf_layout = LEAF_LAYOUT_PAX;
+      } else if (strcmp(argv[i], "row") == 0) {
+        options.leaf_layout = LEAF_LAYOUT_ROW;
+      } else {
+        printf("Leaf layout must be row or pax.\n");
+        exit(EXIT_FAILURE);
       }
+    } else if (strcmp(argv[i], "--compress") == 0) {
+      options.compress = true;
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      script_filename = argv[++i];
+    } else if (strcmp(argv[i], "--interactive") == 0) {
+      interactive = true;
+    } else {
+      printf("Usage: %s FILENAME [--page-size BYTES] [--compress] [--leaf-layout row|pax] [--server SOCKET_PATH] [-f SCRIPT] [--interactive]\n", argv[0]);
+      exit(EXIT_FAILURE);
     }
+  }
 
-    Statement statement;
-    switch (prepare_statement(input_buffer, &statement)) {
-      case (PREPARE_SUCCESS):
-        break;
-      case (PREPARE_STRING_TOO_LONG):
-        printf("String is too long.\n");
-        continue;
-      case (PREPARE_SYNTAX_ERROR): 
-        printf("Syntax error. Could not parse statement.\n");
-        continue;
-      case (PREPARE_UNRECOGNIZED_STATEMENT):
-        printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
-        continue;
-    }
+  Table* table = db_open(filename, &options);
+  arena_init(&statement_arena);
+
+  if (socket_path != NULL) {
+    run_server(table, socket_path);
+    exit(EXIT_SUCCESS);
+  }
 
-    switch (execute_statement(&statement, table)) {
-      case (EXECUTE_SUCCESS):
-        printf("Executed.\n");
-        break;
-      case (EXECUTE_DUPLICATE_KEY):
-        printf("Error: Duplicate key.\n");
-        break;
-      case (EXECUTE_TABLE_FULL):
-        printf("Error: Table full.\n");
-        break;
+  // scripts and pipes run without prompts unless asked to.
+  if (script_filename != NULL || (!interactive && !isatty(STDIN_FILENO))) {
+    int fd = STDIN_FILENO;
+    if (script_filename != NULL) {
+      fd = open(script_filename, O_RDONLY);
+      if (fd == -1) {
+        printf("Unable to open script %s\n", script_filename);
+        exit(EXIT_FAILURE);
+      }
     }
+    run_script(fd, table);
+    db_close(table);
+    exit(EXIT_SUCCESS);
+  }
+
+  // getline keeps reusing the same line buffer.
+  InputBuffer input_buffer = { NULL, 0, 0 };
+  while (true) {
+    print_prompt();
+    read_input(&input_buffer);
+    run_statement(&input_buffer, table);
   }
 }
\ No newline at end of file
@@ -1,13 +1,71 @@
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <fcntl.h>
+#include <libgen.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "common.h"
 #include "pager.h"
+#include "stats.h"
+#include "compression.h"
+#include "upgrade.h"
+
+static bool is_compressed(Pager* pager) {
+  return (pager->header.flags & DB_FLAG_COMPRESSED) != 0;
+}
+
+// compress a page and write it to its extent, moving it to the end of the file if it outgrew it.
+static void flush_compressed_page(Pager* pager, uint32_t page_num) {
+  uint8_t* stored = pager->compression_buffer;
+  uint32_t length = compress_page(pager->pages[page_num], pager->page_size, stored);
+  if (length >= pager->page_size) {
+    // incompressible, store it raw.
+    stored = pager->pages[page_num];
+    length = pager->page_size;
+  }
+
+  PageExtent* extent = &pager->extents[page_num];
+  if (length > extent->capacity) {
+    extent->offset = pager->file_length;
+    extent->capacity = (length + COMPRESSED_EXTENT_ALIGNMENT - 1) & ~(COMPRESSED_EXTENT_ALIGNMENT - 1);
+    pager->file_length += extent->capacity;
+  }
+  extent->length = length;
+
+  ssize_t bytes_written = pwrite(pager->file_descriptor, stored, length, extent->offset);
+  if (bytes_written == -1) {
+    printf("Error writing: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  stats_add(pages_written, 1);
+  stats_add(bytes_written, length);
+}
+
+// read a page of a compressed database into page.
+static void load_compressed_page(Pager* pager, uint32_t page_num, void* page) {
+  PageExtent* extent = &pager->extents[page_num];
+  if (extent->length == 0) {
+    return;
+  }
+
+  void* stored = extent->length == pager->page_size ? page : pager->compression_buffer;
+  ssize_t bytes_read = pread(pager->file_descriptor, stored, extent->length, extent->offset);
+  if (bytes_read != extent->length) {
+    printf("Error reading file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  if (stored != page && !decompress_page(stored, extent->length, page, pager->page_size)) {
+    printf("Page %d is corrupt.\n", page_num);
+    exit(EXIT_FAILURE);
+  }
+  stats_add(pages_read, 1);
+  stats_add(bytes_read, extent->length);
+}
 
 void pager_flush(Pager* pager, uint32_t page_num) {
   if (pager->pages[page_num] == NULL) {
@@ -15,80 +73,304 @@ void pager_flush(Pager* pager, uint32_t page_num) {
     exit(EXIT_FAILURE);
   }
 
-  off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
+  if (is_compressed(pager)) {
+    flush_compressed_page(pager, page_num);
+    return;
+  }
+
+  off_t offset = lseek(pager->file_descriptor, (off_t)page_num * pager->page_size, SEEK_SET);
 
   if (offset == -1) {
     printf("Error seeking: %d\n", errno);
     exit(EXIT_FAILURE);
   }
 
-  ssize_t bytes_written = write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
+  ssize_t bytes_written = write(pager->file_descriptor, pager->pages[page_num], pager->page_size);
 
   if (bytes_written == -1) {
     printf("Error writing: %d\n", errno);
     exit(EXIT_FAILURE);
   }
+  stats_add(pages_written, 1);
+  stats_add(bytes_written, pager->page_size);
 }
 
-Pager* pager_open(const char* filename) {
+// write the in memory header to page 0.
+void pager_write_header(Pager* pager) {
+  pager->header.num_pages = pager->num_pages;
+
+  void* page = calloc(1, pager->page_size);
+  memcpy(page, &pager->header, sizeof(DatabaseHeader));
+  if (is_compressed(pager)) {
+    memcpy(page + sizeof(DatabaseHeader), pager->extents, sizeof(pager->extents));
+  }
+  ssize_t bytes_written = pwrite(pager->file_descriptor, page, pager->page_size, 0);
+  free(page);
+
+  if (bytes_written == -1) {
+    printf("Error writing header: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  stats_add(pages_written, 1);
+  stats_add(bytes_written, pager->page_size);
+}
+
+static bool is_valid_page_size(uint32_t page_size) {
+  // a power of two within the supported range.
+  return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE && (page_size & (page_size - 1)) == 0;
+}
+
+// a compressed database keeps its page map in page 0, after the header.
+static bool page_map_fits(uint32_t page_size) {
+  return sizeof(DatabaseHeader) + TABLE_MAX_PAGES * sizeof(PageExtent) <= page_size;
+}
+
+void sync_directory(const char* path) {
+  char* path_copy = strdup(path);
+  int fd = open(dirname(path_copy), O_RDONLY);
+  free(path_copy);
+  if (fd == -1 || fsync(fd) == -1) {
+    printf("Error syncing directory: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+}
+
+// read and validate the header of an existing database.
+static void read_header(Pager* pager) {
+  int fd = pager->file_descriptor;
+  DatabaseHeader* header = &pager->header;
+  ssize_t bytes_read = pread(fd, header, sizeof(DatabaseHeader), 0);
+  if (bytes_read == -1) {
+    printf("Error reading header: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  if (bytes_read != sizeof(DatabaseHeader) || memcmp(header->magic, DB_HEADER_MAGIC, sizeof(header->magic)) != 0) {
+    printf("File is not a database.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (header->version != DB_HEADER_VERSION) {
+    printf("Unsupported database version %d.\n", header->version);
+    exit(EXIT_FAILURE);
+  }
+  if (!is_valid_page_size(header->page_size)) {
+    printf("Invalid page size %d. Corrupt file.\n", header->page_size);
+    exit(EXIT_FAILURE);
+  }
+  if (header->flags & DB_FLAG_COMPRESSED) {
+    if (header->num_pages > TABLE_MAX_PAGES || !page_map_fits(header->page_size)) {
+      printf("Page map does not fit this build's page cache.\n");
+      exit(EXIT_FAILURE);
+    }
+    bytes_read = pread(fd, pager->extents, sizeof(pager->extents), sizeof(DatabaseHeader));
+    if (bytes_read != sizeof(pager->extents)) {
+      printf("Error reading page map: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+  }
+  stats_add(pages_read, 1);
+  stats_add(bytes_read, header->page_size);
+}
+
+static void initialize_header(DatabaseHeader* header, CreateOptions* options) {
+  memset(header, 0, sizeof(DatabaseHeader));
+  memcpy(header->magic, DB_HEADER_MAGIC, sizeof(header->magic));
+  header->version = DB_HEADER_VERSION;
+  header->page_size = options->page_size;
+  // the header occupies page 0. the tree is created by the caller.
+  header->num_pages = 1;
+  header->root_page_num = 0;
+  header->freelist_head = 0;
+  header->num_rows = 0;
+  strncpy(header->schema, DB_SCHEMA, SCHEMA_SIZE - 1);
+  header->flags = options->compress ? DB_FLAG_COMPRESSED : 0;
+  if (options->leaf_layout == LEAF_LAYOUT_PAX) {
+    header->flags |= DB_FLAG_PAX_LEAVES;
+  }
+}
+
+// open the pager's file and load its layout from the header.
+static void open_file(Pager* pager, CreateOptions* options) {
   // open db file.
-  int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+  int fd = open(pager->filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
   if (fd == -1) {
     printf("Unable to open file\n");
     exit(EXIT_FAILURE);
   }
   // size
   off_t file_length = lseek(fd, 0, SEEK_END);
-  // create pager.
-  Pager* pager = malloc(sizeof(Pager));
+  if (is_headerless_database(fd, file_length)) {
+    upgrade_headerless_database(pager->filename, fd, file_length);
+    close(fd);
+    fd = open(pager->filename, O_RDWR);
+    if (fd == -1) {
+      printf("Unable to open file\n");
+      exit(EXIT_FAILURE);
+    }
+    file_length = lseek(fd, 0, SEEK_END);
+  }
   pager->file_descriptor = fd;
   pager->file_length = file_length;
-  pager->num_pages = (file_length / PAGE_SIZE);
 
-  if (file_length % PAGE_SIZE != 0) {
+  // everything needed to open the file comes from its header.
+  memset(pager->extents, 0, sizeof(pager->extents));
+  if (file_length == 0) {
+    if (options->compress && !page_map_fits(options->page_size)) {
+      printf("Page map does not fit in a page, use a larger page size.\n");
+      exit(EXIT_FAILURE);
+    }
+    initialize_header(&pager->header, options);
+    pager->page_size = options->page_size;
+    pager->num_pages = 1;
+    pager_write_header(pager);
+    pager->file_length = pager->page_size;
+  } else {
+    read_header(pager);
+  }
+  pager->page_size = pager->header.page_size;
+  pager->num_pages = pager->header.num_pages;
+
+  free(pager->compression_buffer);
+  pager->compression_buffer = NULL;
+  if (is_compressed(pager)) {
+    // compressed pages are packed, so the file is not a whole number of pages.
+    pager->compression_buffer = malloc(compress_bound(pager->page_size));
+    return;
+  }
+
+  if (pager->file_length % pager->page_size != 0) {
     printf("db file is not a whole number of pages. Corrupt file.\n");
     exit(EXIT_FAILURE);
   }
+}
+
+Pager* pager_open(const char* filename, CreateOptions* options) {
+  if (!is_valid_page_size(options->page_size)) {
+    printf("Page size must be a power of two between %d and %d.\n", MIN_PAGE_SIZE, MAX_PAGE_SIZE);
+    exit(EXIT_FAILURE);
+  }
 
-  // initialize page cache.
+  // create pager.
+  Pager* pager = malloc(sizeof(Pager));
+  pager->filename = strdup(filename);
+  pager->compression_buffer = NULL;
+  open_file(pager, options);
+
+  // initialize page cache and latches.
+  // frames come from one block, so a cache miss never goes to the allocator.
+  pager->frames = malloc((size_t)TABLE_MAX_PAGES * pager->page_size);
+  pthread_mutex_init(&pager->lock, NULL);
+  // glibc latches prefer readers by default, which lets a stream of readers starve the writer.
+  pthread_rwlockattr_t latch_attributes;
+  pthread_rwlockattr_init(&latch_attributes);
+  pthread_rwlockattr_setkind_np(&latch_attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
   for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
     pager->pages[i] = NULL;
+    pthread_rwlock_init(&pager->latches[i], &latch_attributes);
   }
+  pthread_rwlockattr_destroy(&latch_attributes);
+
+  return pager;
 }
 
+// switch the pager to the current contents of its file, dropping every cached page.
+// used after the file has been replaced. the caller must keep every page latched.
+void pager_reopen(Pager* pager) {
+  pthread_mutex_lock(&pager->lock);
+  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
+    __atomic_store_n(&pager->pages[i], NULL, __ATOMIC_RELEASE);
+  }
+  close(pager->file_descriptor);
+
+  CreateOptions options = { pager->page_size, false, LEAF_LAYOUT_ROW };
+  open_file(pager, &options);
+  pthread_mutex_unlock(&pager->lock);
+}
+
+// callers hold the frame latch, or are the writer fetching a page nobody else can reach,
+// so a cached slot cannot change under them and a hit needs no lock.
+// slots are written with release stores, after the frame is filled.
 void* get_page(Pager* pager, uint32_t page_num) {
-  // handle cache miss.
-  if (pager->pages[page_num] == NULL) {
-    // allocate memory
-    void* page = malloc(PAGE_SIZE);
-    uint32_t num_pages = pager->num_pages;
+  void* page = __atomic_load_n(&pager->pages[page_num], __ATOMIC_ACQUIRE);
+  if (page != NULL) {
+    stats_add(cache_hits, 1);
+    return page;
+  }
 
-    // handle partial page.
-    if (pager->file_length % PAGE_SIZE) {
-      num_pages += 1;
-    }
+  pthread_mutex_lock(&pager->lock);
+
+  // handle cache miss, unless another thread loaded the page while we waited.
+  if (pager->pages[page_num] == NULL) {
+    stats_add(cache_misses, 1);
+    // an uncached page owns the frame of its slot: pages only trade frames in
+    // pager_swap_pages, and both are cached then.
+    // frames are reused, so new pages are zeroed to keep stale bytes out of the file.
+    void* page = pager->frames + (size_t)page_num * pager->page_size;
+    memset(page, 0, pager->page_size);
 
-    if (page_num <= num_pages) {
+    // pages past the end of the file are new and have nothing to load.
+    if (page_num < pager->num_pages && is_compressed(pager)) {
+      load_compressed_page(pager, page_num, page);
+    } else if (page_num < pager->num_pages) {
     // load from file.
-      lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-      ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
+      lseek(pager->file_descriptor, (off_t)page_num * pager->page_size, SEEK_SET);
+      ssize_t bytes_read = read(pager->file_descriptor, page, pager->page_size);
       if (bytes_read == -1) {
         printf("Error reading file: %d\n", errno);
         exit(EXIT_FAILURE);
       }
+      stats_add(pages_read, 1);
+      stats_add(bytes_read, bytes_read);
     }
 
-    pager->pages[page_num] = page;
+    __atomic_store_n(&pager->pages[page_num], page, __ATOMIC_RELEASE);
 
     if (page_num >= pager->num_pages) {
       pager->num_pages = page_num + 1;
     }
 
+  } else {
+    stats_add(cache_hits, 1);
   }
 
-  return pager->pages[page_num];
+  page = pager->pages[page_num];
+  pthread_mutex_unlock(&pager->lock);
+  return page;
 }
 
+// only the writer allocates pages, so the result stays unused until it is fetched.
 uint32_t get_unused_page_num(Pager* pager) {
-  return pager->num_pages;
-} 
\ No newline at end of file
+  pthread_mutex_lock(&pager->lock);
+  uint32_t page_num = pager->num_pages;
+  pthread_mutex_unlock(&pager->lock);
+  return page_num;
+}
+
+// exchange the contents of two pages. the caller must hold both latches exclusively.
+void pager_swap_pages(Pager* pager, uint32_t a, uint32_t b) {
+  get_page(pager, a);
+  get_page(pager, b);
+
+  pthread_mutex_lock(&pager->lock);
+  void* page = pager->pages[a];
+  __atomic_store_n(&pager->pages[a], pager->pages[b], __ATOMIC_RELEASE);
+  __atomic_store_n(&pager->pages[b], page, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&pager->lock);
+}
+
+void pager_latch(Pager* pager, uint32_t page_num, LatchMode mode) {
+  switch (mode) {
+    case (LATCH_SHARED):
+      pthread_rwlock_rdlock(&pager->latches[page_num]);
+      break;
+    case (LATCH_EXCLUSIVE):
+      pthread_rwlock_wrlock(&pager->latches[page_num]);
+      break;
+    case (LATCH_NONE):
+      break;
+  }
+}
+
+void pager_unlatch(Pager* pager, uint32_t page_num) {
+  pthread_rwlock_unlock(&pager->latches[page_num]);
+}
\ No newline at end of file
@@ -4,10 +4,22 @@
 #include <stdint.h>
 #include "common.h"
 
+// compressed pages are stored in extents aligned to this many bytes.
+#define COMPRESSED_EXTENT_ALIGNMENT 64
+
 // flush a page to disk.
 void pager_flush(Pager* pager, uint32_t page_num);
-Pager* pager_open(const char* filename);
+Pager* pager_open(const char* filename, CreateOptions* options);
+void pager_reopen(Pager* pager);
+// write the in memory header to page 0.
+void pager_write_header(Pager* pager);
 void* get_page(Pager* pager, uint32_t page_num);
 uint32_t get_unused_page_num(Pager* pager);
+void pager_swap_pages(Pager* pager, uint32_t a, uint32_t b);
+// take or release the reader/writer latch of a buffer frame.
+void pager_latch(Pager* pager, uint32_t page_num, LatchMode mode);
+void pager_unlatch(Pager* pager, uint32_t page_num);
+// make a rename in the directory of path durable.
+void sync_directory(const char* path);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "vm.h"
+#include "server.h"
+#include "stats.h"
+
+// per client state. input holds unparsed bytes, output holds unsent responses.
+typedef struct {
+  int fd;
+  char* input;
+  size_t input_length;
+  char* output;
+  size_t output_length;
+  size_t output_capacity;
+  size_t output_sent;
+  bool closing;
+  // events currently registered with epoll.
+  uint32_t events;
+} Connection;
+
+static volatile sig_atomic_t server_stopping = 0;
+
+// requests run one at a time, so they share one scratch arena.
+static Arena request_arena;
+
+static void handle_stop_signal(int signal_number) {
+  server_stopping = 1;
+}
+
+// output buffer
+
+static void output_reserve(Connection* connection, size_t size) {
+  size_t needed = connection->output_length + size;
+  if (needed <= connection->output_capacity) {
+    return;
+  }
+  size_t capacity = connection->output_capacity ? connection->output_capacity : 4096;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  connection->output = realloc(connection->output, capacity);
+  connection->output_capacity = capacity;
+}
+
+static void output_append(Connection* connection, const void* data, size_t size) {
+  output_reserve(connection, size);
+  memcpy(connection->output + connection->output_length, data, size);
+  connection->output_length += size;
+}
+
+static void output_append_uint32(Connection* connection, uint32_t value) {
+  uint8_t bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+  output_append(connection, bytes, sizeof(bytes));
+}
+
+static void output_append_string(Connection* connection, const char* string) {
+  uint8_t length = strlen(string);
+  output_append(connection, &length, sizeof(length));
+  output_append(connection, string, length);
+}
+
+// response encoding
+
+typedef struct {
+  Connection* connection;
+  size_t num_rows_offset;
+  uint32_t num_rows;
+} ResponseWriter;
+
+static void encode_row(Row* row, void* context) {
+  ResponseWriter* writer = context;
+  output_append_uint32(writer->connection, row->id);
+  output_append_string(writer->connection, row->username);
+  output_append_string(writer->connection, row->email);
+  writer->num_rows += 1;
+}
+
+static ServerStatus status_from_execute_result(ExecuteResult result) {
+  switch (result) {
+    case (EXECUTE_SUCCESS):
+      return SERVER_STATUS_SUCCESS;
+    case (EXECUTE_DUPLICATE_KEY):
+      return SERVER_STATUS_DUPLICATE_KEY;
+    case (EXECUTE_TABLE_FULL):
+    default:
+      return SERVER_STATUS_TABLE_FULL;
+  }
+}
+
+static ServerStatus status_from_prepare_result(PrepareResult result) {
+  switch (result) {
+    case (PREPARE_SYNTAX_ERROR):
+      return SERVER_STATUS_SYNTAX_ERROR;
+    case (PREPARE_STRING_TOO_LONG):
+      return SERVER_STATUS_STRING_TOO_LONG;
+    default:
+      return SERVER_STATUS_UNRECOGNIZED_STATEMENT;
+  }
+}
+
+// run one request line and append its response.
+static void handle_request(Connection* connection, Table* table, char* line, size_t line_length) {
+  // reserve the header, the row count is patched once the rows are written.
+  ResponseWriter writer = { connection, connection->output_length + 1, 0 };
+  uint8_t status = SERVER_STATUS_SUCCESS;
+  output_append(connection, &status, sizeof(status));
+  output_append_uint32(connection, 0);
+
+  InputBuffer input_buffer = { line, line_length + 1, line_length };
+  Statement statement;
+  statement.arena = &request_arena;
+  uint64_t start_ns = stats_now_ns();
+  PrepareResult prepare_result = prepare_statement(&input_buffer, &statement);
+  uint64_t prepared_ns = stats_now_ns();
+  stats_add(prepare_ns, prepared_ns - start_ns);
+  if (prepare_result == PREPARE_SUCCESS) {
+    status = status_from_execute_result(execute_statement(&statement, table, encode_row, &writer));
+    arena_reset(&request_arena);
+    stats_add(execute_ns, stats_now_ns() - prepared_ns);
+    stats_add(statements, 1);
+  } else {
+    status = status_from_prepare_result(prepare_result);
+  }
+
+  char* header = connection->output + writer.num_rows_offset - 1;
+  header[0] = status;
+  uint8_t* num_rows = (uint8_t*)header + 1;
+  num_rows[0] = writer.num_rows;
+  num_rows[1] = writer.num_rows >> 8;
+  num_rows[2] = writer.num_rows >> 16;
+  num_rows[3] = writer.num_rows >> 24;
+}
+
+// a client that does not read its responses is paused until they are sent.
+static bool output_backlogged(Connection* connection) {
+  return connection->output_length - connection->output_sent >= SERVER_MAX_PENDING_OUTPUT;
+}
+
+static bool has_pending_request(Connection* connection) {
+  return memchr(connection->input, '\n', connection->input_length) != NULL;
+}
+
+// run complete lines in the input buffer until the output backlog is full.
+// unanswered lines and a trailing partial line are kept.
+static void handle_requests(Connection* connection, Table* table) {
+  char* start = connection->input;
+  char* end = connection->input + connection->input_length;
+  char* newline;
+  while (!output_backlogged(connection) && (newline = memchr(start, '\n', end - start)) != NULL) {
+    size_t line_length = newline - start;
+    if (line_length > 0 && start[line_length - 1] == '\r') {
+      line_length -= 1;
+    }
+    start[line_length] = 0;
+    handle_request(connection, table, start, line_length);
+    start = newline + 1;
+  }
+  connection->input_length = end - start;
+  memmove(connection->input, start, connection->input_length);
+}
+
+// connections
+
+// register interest in input unless closing or backlogged, and in output while some is pending.
+// epoll is only updated when the interest changes.
+static void watch_connection(int epoll_fd, int operation, Connection* connection) {
+  struct epoll_event event;
+  event.events = connection->closing || output_backlogged(connection) ? 0 : EPOLLIN;
+  if (connection->output_sent < connection->output_length) {
+    event.events |= EPOLLOUT;
+  }
+  if (operation == EPOLL_CTL_MOD && event.events == connection->events) {
+    return;
+  }
+  connection->events = event.events;
+  event.data.ptr = connection;
+  if (epoll_ctl(epoll_fd, operation, connection->fd, &event) == -1) {
+    printf("Error watching connection: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void close_connection(int epoll_fd, Connection* connection) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+  close(connection->fd);
+  free(connection->input);
+  free(connection->output);
+  free(connection);
+}
+
+static void accept_connections(int epoll_fd, int listen_fd) {
+  while (true) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+      return;
+    }
+    Connection* connection = calloc(1, sizeof(Connection));
+    connection->fd = fd;
+    connection->input = malloc(SERVER_MAX_REQUEST_SIZE);
+    watch_connection(epoll_fd, EPOLL_CTL_ADD, connection);
+  }
+}
+
+// drop the sent part of the output buffer once it is at least as large as the unsent part,
+// so the buffer stays within twice the pending output and each byte moves at most once on average.
+static void output_compact(Connection* connection) {
+  size_t unsent = connection->output_length - connection->output_sent;
+  if (connection->output_sent < unsent) {
+    return;
+  }
+  memmove(connection->output, connection->output + connection->output_sent, unsent);
+  connection->output_length = unsent;
+  connection->output_sent = 0;
+}
+
+// send as much pending output as the socket accepts.
+// returns false if the connection failed.
+static bool flush_output(Connection* connection) {
+  while (connection->output_sent < connection->output_length) {
+    ssize_t bytes_sent = send(connection->fd, connection->output + connection->output_sent,
+        connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+    if (bytes_sent == -1) {
+      bool would_block = errno == EAGAIN || errno == EWOULDBLOCK;
+      // a client that keeps reading may never let the buffer drain completely.
+      output_compact(connection);
+      return would_block;
+    }
+    connection->output_sent += bytes_sent;
+  }
+  connection->output_length = 0;
+  connection->output_sent = 0;
+  return true;
+}
+
+// answer requests left from a pause, then read and answer what is available
+// until the output backlog is full. returns false if the connection failed.
+static bool read_input(Connection* connection, Table* table) {
+  handle_requests(connection, table);
+  while (!connection->closing && !output_backlogged(connection)) {
+    size_t space = SERVER_MAX_REQUEST_SIZE - connection->input_length;
+    if (space == 0) {
+      // request line too long.
+      return false;
+    }
+    ssize_t bytes_read = read(connection->fd, connection->input + connection->input_length, space);
+    if (bytes_read == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return false;
+    }
+    if (bytes_read == 0) {
+      // client finished sending, answer what is left before closing.
+      connection->closing = true;
+      break;
+    }
+    connection->input_length += bytes_read;
+    handle_requests(connection, table);
+  }
+  return true;
+}
+
+// answer and send in turns while the client keeps up, so pending output stays bounded.
+// returns false if the connection failed.
+static bool serve_connection(Connection* connection, Table* table) {
+  do {
+    if (!read_input(connection, table) || !flush_output(connection)) {
+      return false;
+    }
+  } while (connection->output_length == 0 && has_pending_request(connection));
+  return true;
+}
+
+static int listen_on(const char* socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    printf("Socket path is too long.\n");
+    exit(EXIT_FAILURE);
+  }
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    printf("Error creating socket: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  unlink(socket_path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    printf("Error binding socket: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  if (listen(fd, SOMAXCONN) == -1) {
+    printf("Error listening on socket: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+void run_server(Table* table, const char* socket_path) {
+  // stop on SIGINT and SIGTERM so pages are flushed on the way out.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  arena_init(&request_arena);
+  int listen_fd = listen_on(socket_path);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1) {
+    printf("Error creating epoll instance: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  // the listening socket is the only event without a connection.
+  struct epoll_event listen_event;
+  listen_event.events = EPOLLIN;
+  listen_event.data.ptr = NULL;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+  struct epoll_event events[SERVER_MAX_EVENTS];
+  while (!server_stopping) {
+    int num_events = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+    if (num_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("Error waiting for events: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      Connection* connection = events[i].data.ptr;
+      if (connection == NULL) {
+        accept_connections(epoll_fd, listen_fd);
+        continue;
+      }
+
+      // output may have drained below the cap, so even a writable event reads input.
+      bool ok = serve_connection(connection, table);
+      bool drained = connection->output_sent == connection->output_length;
+      if (!ok || (connection->closing && drained)) {
+        close_connection(epoll_fd, connection);
+      } else {
+        watch_connection(epoll_fd, EPOLL_CTL_MOD, connection);
+      }
+    }
+  }
+
+  // connections still open at shutdown are dropped.
+  close(epoll_fd);
+  close(listen_fd);
+  unlink(socket_path);
+  arena_free(&request_arena);
+  db_close(table);
+}
@@ -0,0 +1,32 @@
+#ifndef server_h
+#define server_h
+
+#include "common.h"
+
+// server mode serves many clients over a unix domain socket from one event loop.
+// clients send statements as newline-terminated text and may pipeline them.
+// every statement gets one binary response, in request order:
+//   uint8  status (ServerStatus)
+//   uint32 number of rows that follow (little endian)
+// and for each row:
+//   uint32 id, uint8 username length, username bytes, uint8 email length, email bytes.
+
+typedef enum {
+  SERVER_STATUS_SUCCESS,
+  SERVER_STATUS_DUPLICATE_KEY,
+  SERVER_STATUS_TABLE_FULL,
+  SERVER_STATUS_SYNTAX_ERROR,
+  SERVER_STATUS_STRING_TOO_LONG,
+  SERVER_STATUS_UNRECOGNIZED_STATEMENT
+} ServerStatus;
+
+// longest request line a client may send before it is disconnected.
+#define SERVER_MAX_REQUEST_SIZE 4096
+#define SERVER_MAX_EVENTS 64
+// a client is not read from while this many response bytes wait to be sent to it.
+#define SERVER_MAX_PENDING_OUTPUT (1 << 20)
+
+// listen on socket_path until SIGINT or SIGTERM, then close the table.
+void run_server(Table* table, const char* socket_path);
+
+#endif
@@ -1,11 +1,13 @@
+require 'socket'
+
 describe 'database' do 
   before do
-    `rm -rf test.db`
+    `rm -rf test.db test.db-vacuum test.db-upgrade test.sock test.sql`
   end
 
-  def run_script(commands)
+  def run_script(commands, options = "")
     raw_output = nil
-    IO.popen("./db test.db", "r+") do |pipe|
+    IO.popen("./db test.db --interactive #{options}", "r+") do |pipe|
       commands.each do |command|
         begin
           pipe.puts command
@@ -64,8 +66,8 @@ describe 'database' do
     script << ".exit"
     result = run_script(script)
     expect(result.last(2)).to match_array([
-      "db > Executed.",
-      "db > Need to implement updating parent after split",
+      "db > Error: Table full.",
+      "db > ",
     ])
   end
 
@@ -192,4 +194,328 @@ describe 'database' do
       "db > ",
     ])
   end
-end
\ No newline at end of file
+
+  it 'serves pipelined statements over a unix socket' do
+    server = Process.spawn("./db test.db --server test.sock")
+    sleep 0.01 until File.exist?("test.sock")
+
+    response = UNIXSocket.open("test.sock") do |socket|
+      socket.write("insert 1 user1 person1@example.com\n")
+      socket.write("insert 1 user1 person1@example.com\nselect\nbogus\n")
+      socket.close_write
+      socket.read
+    end
+    Process.kill("TERM", server)
+    Process.wait(server)
+
+    expect(response.bytes).to eq([
+      [0, 0].pack("CV"),
+      [1, 0].pack("CV"),
+      [0, 1, 1, 5, "user1", 19, "person1@example.com"].pack("CVVCa*Ca*"),
+      [5, 0].pack("CV"),
+    ].join.bytes)
+  end
+
+  it 'answers every request of a client that reads its responses late' do
+    server = Process.spawn("./db test.db --server test.sock")
+    sleep 0.01 until File.exist?("test.sock")
+
+    rows = (1..10).map { |i| "insert #{i} user#{i} person#{i}@example.com\n" }.join
+    num_selects = 20000
+    response = UNIXSocket.open("test.sock") do |socket|
+      # more responses than the server buffers, so it has to pause reading this client.
+      writer = Thread.new do
+        socket.write(rows + "select\n" * num_selects)
+        socket.close_write
+      end
+      sleep 0.2
+      response = socket.read
+      writer.join
+      response
+    end
+    Process.kill("TERM", server)
+    Process.wait(server)
+
+    select_response = [0, 10].pack("CV") + (1..10).map do |i|
+      [i, "user#{i}".length, "user#{i}", "person#{i}@example.com".length, "person#{i}@example.com"].pack("VCa*Ca*")
+    end.join
+    expect(response.bytesize).to eq(10 * 5 + num_selects * select_response.bytesize)
+    expect(response.byteslice(-select_response.bytesize..)).to eq(select_response)
+  end
+
+  it 'keeps server memory bounded for a client that reads slowly but keeps up' do
+    server = Process.spawn("./db test.db --server test.sock")
+    sleep 0.01 until File.exist?("test.sock")
+
+    rows = (1..10).map { |i| "insert #{i} user#{i} person#{i}@example.com\n" }.join
+    num_selects = 200000
+    received = 0
+    max_rss_kb = 0
+    UNIXSocket.open("test.sock") do |socket|
+      writer = Thread.new do
+        socket.write(rows)
+        (num_selects / 1000).times { socket.write("select\n" * 1000) }
+        socket.close_write
+      end
+      while (chunk = socket.read(65536))
+        received += chunk.bytesize
+        rss_kb = File.read("/proc/#{server}/status")[/VmRSS:\s+(\d+)/, 1].to_i
+        max_rss_kb = [max_rss_kb, rss_kb].max
+        sleep 0.0002
+      end
+      writer.join
+    end
+    Process.kill("TERM", server)
+    Process.wait(server)
+
+    select_response_size = 5 + (1..10).sum { |i| 4 + 1 + "user#{i}".length + 1 + "person#{i}@example.com".length }
+    expect(received).to eq(10 * 5 + num_selects * select_response_size)
+    # about SERVER_MAX_PENDING_OUTPUT of buffered responses, far below the 60 MB sent.
+    expect(max_rss_kb < 16 * 1024).to eq(true)
+  end
+
+  it 'reports runtime statistics' do
+    script = (1..14).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script.unshift(".stats reset")
+    script << ".stats"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result).to include("cache_misses: 2")
+    expect(result).to include("pages_read: 0")
+    expect(result).to include("leaf_splits: 1")
+    expect(result).to include("root_splits: 1")
+    expect(result).to include("bytes_serialized: #{14 * 293}")
+    expect(result).to include("statements: 14")
+  end
+
+  it 'prints statement latency when the timer is on' do
+    result = run_script([
+      ".timer on",
+      "insert 1 user1 person1@example.com",
+      ".timer off",
+      "select",
+      ".exit",
+    ])
+    expect(result.count { |line| line.start_with?("Run Time: prepare ") }).to eq(1)
+  end
+
+  it 'persists database metadata in the header page' do
+    script = (1..3).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--page-size 16384")
+
+    result = run_script([
+      ".dbinfo",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "db > Database:",
+      "version: 1",
+      "page_size: 16384",
+      "root_page_num: 1",
+      "num_pages: 2",
+      "freelist_head: 0",
+      "num_rows: 3",
+      "compressed: no",
+      "leaf_layout: row",
+      "schema: CREATE TABLE users (id INTEGER PRIMARY KEY, username VARCHAR(32), email VARCHAR(255));",
+      "db > ",
+    ])
+  end
+
+  it 'vacuums the table into densely packed leaves' do
+    script = (1..16).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".vacuum incremental 10"
+    script << ".vacuum"
+    script << ".exit"
+    result = run_script(script)
+    expect(result.last(2)).to match_array([
+      "db > Pages relocated: 1",
+      "db > db > ",
+    ])
+
+    result = run_script([
+      ".btree",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "db > Tree:",
+      "- internal (size 1)",
+      "  - leaf (size 12)",
+      *(1..12).map { |i| "    - #{i}" },
+      "  - key 12",
+      "  - leaf (size 4)",
+      *(13..16).map { |i| "    - #{i}" },
+      "db > ",
+    ])
+  end
+
+  it 'splits vacuumed leaves on insert' do
+    script = (1..16).map do |i|
+      "insert #{i * 2} user#{i * 2} person#{i * 2}@example.com"
+    end
+    script << ".vacuum"
+    script += (0..15).map do |i|
+      "insert #{i * 2 + 1} user#{i * 2 + 1} person#{i * 2 + 1}@example.com"
+    end
+    script << ".exit"
+    result = run_script(script)
+    expect(result.count { |line| line.end_with?("Executed.") }).to eq(32)
+
+    result = run_script([
+      "select",
+      ".exit",
+    ])
+    ids = result.map { |line| line[/\((\d+), user/, 1] }.compact.map(&:to_i)
+    expect(ids).to eq((1..32).to_a)
+  end
+
+  it 'splits leaves below the root in any insert order' do
+    keys = (1..200).to_a.shuffle(random: Random.new(7))
+    script = keys.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    result = run_script(script)
+    expect(result.count("db > Executed.")).to eq(200)
+
+    result = run_script([
+      "select",
+      ".exit",
+    ])
+    ids = result.map { |line| line[/\((\d+), user/, 1] }.compact.map(&:to_i)
+    expect(ids).to eq((1..200).to_a)
+  end
+
+  it 'runs piped input as a batch without prompts' do
+    output = IO.popen("./db test.db", "r+") do |pipe|
+      pipe.puts "insert 1 user1 person1@example.com"
+      pipe.puts ""
+      pipe.write "select"
+      pipe.close_write
+      pipe.read
+    end
+    expect(output.split("\n")).to eq([
+      "Executed.",
+      "(1, user1, person1@example.com)",
+      "Executed.",
+    ])
+  end
+
+  it 'runs a script file given with -f' do
+    File.write("test.sql", (1..3).map { |i| "insert #{i} user#{i} person#{i}@example.com\n" }.join + "select\n")
+    output = `./db test.db -f test.sql`
+    expect(output.split("\n")).to eq([
+      "Executed.",
+      "Executed.",
+      "Executed.",
+      "(1, user1, person1@example.com)",
+      "(2, user2, person2@example.com)",
+      "(3, user3, person3@example.com)",
+      "Executed.",
+    ])
+  end
+
+  it 'stores pages compressed when created with --compress' do
+    script = (1..20).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--compress")
+    expect(File.size("test.db") < 4096 + 3000).to eq(true)
+
+    result = run_script([
+      "select",
+      ".dbinfo",
+      ".exit",
+    ])
+    expect(result).to include("compressed: yes")
+    expect(result).to include("db > (1, user1, person1@example.com)")
+    expect(result).to include("(20, user20, person20@example.com)")
+  end
+
+  it 'keeps rows in column order when created with --leaf-layout pax' do
+    script = [7, 2, 12, 1, 9, 4, 14, 3, 11, 5, 13, 6, 10, 8].map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--leaf-layout pax")
+
+    result = run_script([
+      "select",
+      ".dbinfo",
+      ".exit",
+    ])
+    expect(result).to include("leaf_layout: pax")
+    rows = result.select { |line| line.include?("@example.com)") }
+    expect(rows.length).to eq(14)
+    expect(rows.first).to eq("db > (1, user1, person1@example.com)")
+    expect(rows.last).to eq("(14, user14, person14@example.com)")
+  end
+
+  it 'keeps the pax layout when vacuuming' do
+    script = (1..16).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".vacuum"
+    script += (17..30).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << ".exit"
+    run_script(script, "--leaf-layout pax")
+
+    # pages 2 and 3 are the vacuumed leaves, page 4 was split off the last one.
+    # their type byte carries the pax flag.
+    data = File.binread("test.db")
+    (2..4).each do |page_num|
+      expect(data.getbyte(page_num * 4096)).to eq(0x81)
+    end
+
+    result = run_script([
+      "select",
+      ".exit",
+    ])
+    expect(result.count { |line| line.include?("@example.com)") }).to eq(30)
+    expect(result).to include("(30, user30, person30@example.com)")
+  end
+
+  it 'upgrades a database written before the file header' do
+    # the old format: 4096 byte pages, the root in page 0 and
+    # internal keys stored 16 bytes after the start of their cell.
+    leaf = lambda do |keys|
+      cells = keys.map { |i| [i, i, "user#{i}", "person#{i}@example.com"].pack("VVa33a256") }
+      ([1, 0, 0, keys.length].pack("CCVV") + cells.join).ljust(4096, "\0")
+    end
+    root = [0, 1, 0, 1, 1, 2].pack("CCVVVV").ljust(30, "\0") + [7].pack("V")
+    File.binwrite("test.db", root.ljust(4096, "\0") + leaf.call((8..14).to_a) + leaf.call((1..7).to_a))
+
+    result = run_script([
+      "insert 15 user15 person15@example.com",
+      "select",
+      ".dbinfo",
+      ".exit",
+    ])
+    expect(result.first).to eq("Upgraded database to version 1.")
+    rows = result.select { |line| line.include?("@example.com)") }
+    expect(rows.length).to eq(15)
+    expect(rows.first).to eq("db > (1, user1, person1@example.com)")
+    expect(rows.last).to eq("(15, user15, person15@example.com)")
+    expect(result).to include("root_page_num: 1")
+    expect(result).to include("num_pages: 4")
+    expect(result).to include("num_rows: 15")
+
+    result = run_script([
+      ".btree",
+      ".exit",
+    ])
+    expect(result.first).to eq("db > Tree:")
+    expect(result).to include("  - key 7")
+  end
+end
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+Statistics stats;
+
+void stats_reset() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+void print_stats() {
+  printf("cache_hits: %lu\n", stats.cache_hits);
+  printf("cache_misses: %lu\n", stats.cache_misses);
+  printf("pages_read: %lu\n", stats.pages_read);
+  printf("pages_written: %lu\n", stats.pages_written);
+  printf("bytes_read: %lu\n", stats.bytes_read);
+  printf("bytes_written: %lu\n", stats.bytes_written);
+  printf("fsyncs: %lu\n", stats.fsyncs);
+  printf("leaf_splits: %lu\n", stats.leaf_splits);
+  printf("root_splits: %lu\n", stats.root_splits);
+  printf("bytes_serialized: %lu\n", stats.bytes_serialized);
+  printf("statements: %lu\n", stats.statements);
+  printf("prepare_ns: %lu\n", stats.prepare_ns);
+  printf("execute_ns: %lu\n", stats.execute_ns);
+}
+
+uint64_t stats_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,34 @@
+#ifndef stats_h
+#define stats_h
+
+#include <stdint.h>
+
+// process wide counters, updated with relaxed atomics so any thread may bump them.
+typedef struct {
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+  uint64_t pages_read;
+  uint64_t pages_written;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t fsyncs;
+  uint64_t leaf_splits;
+  // a root split replaces the root with an internal node.
+  uint64_t root_splits;
+  uint64_t bytes_serialized;
+  uint64_t statements;
+  // time spent preparing (parsing and planning) and executing statements.
+  uint64_t prepare_ns;
+  uint64_t execute_ns;
+} Statistics;
+
+extern Statistics stats;
+
+#define stats_add(field, amount) __atomic_fetch_add(&stats.field, (amount), __ATOMIC_RELAXED)
+
+void stats_reset();
+void print_stats();
+// monotonic clock for timing statements.
+uint64_t stats_now_ns();
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "btree.h"
+#include "pager.h"
+#include "upgrade.h"
+
+bool is_headerless_database(int fd, off_t file_length) {
+  if (file_length == 0 || file_length % HEADERLESS_PAGE_SIZE != 0) {
+    return false;
+  }
+  uint8_t node_header[COMMON_NODE_HEADER_SIZE];
+  if (pread(fd, node_header, sizeof(node_header), 0) != sizeof(node_header)) {
+    return false;
+  }
+  // a header page starts with the magic, a headerless root with its node type and root flag.
+  uint8_t node_type = node_header[NODE_TYPE_OFFSET];
+  uint8_t is_root = node_header[IS_ROOT_OFFSET];
+  return (node_type == NODE_INTERNAL || node_type == NODE_LEAF) && is_root == 1;
+}
+
+// old internal nodes added the child size to a uint32_t pointer,
+// which put key i 16 bytes after the start of cell i.
+static uint32_t* headerless_internal_node_key(void* node, uint32_t key_num) {
+  return internal_node_child(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
+}
+
+// move node to its page in the upgraded file and count the rows it holds.
+static uint64_t upgrade_node(void* node, uint32_t num_pages) {
+  if (get_node_type(node) == NODE_LEAF) {
+    if (*leaf_node_num_cells(node) > leaf_node_max_cells(HEADERLESS_PAGE_SIZE)) {
+      printf("Invalid leaf node. Corrupt file.\n");
+      exit(EXIT_FAILURE);
+    }
+    return *leaf_node_num_cells(node);
+  }
+  uint32_t num_keys = *internal_node_num_keys(node);
+  if (get_node_type(node) != NODE_INTERNAL || num_keys > internal_node_max_cells(HEADERLESS_PAGE_SIZE)) {
+    printf("Invalid internal node. Corrupt file.\n");
+    exit(EXIT_FAILURE);
+  }
+  // the old key slots overlap child pointers, so move every key before touching a child.
+  for (uint32_t i = 0; i < num_keys; i++) {
+    *internal_node_key(node, i) = *headerless_internal_node_key(node, i);
+  }
+  for (uint32_t i = 0; i <= num_keys; i++) {
+    uint32_t* child = internal_node_child(node, i);
+    if (*child >= num_pages) {
+      printf("Invalid child page %d. Corrupt file.\n", *child);
+      exit(EXIT_FAILURE);
+    }
+    *child += 1;
+  }
+  return 0;
+}
+
+void upgrade_headerless_database(const char* filename, int fd, off_t file_length) {
+  uint32_t num_pages = file_length / HEADERLESS_PAGE_SIZE;
+  if (num_pages + 1 > TABLE_MAX_PAGES) {
+    printf("Database is too large to upgrade with this build's page cache.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // page 0 of the new file is the header, page i + 1 is old page i.
+  void* pages = calloc(num_pages + 1, HEADERLESS_PAGE_SIZE);
+  void* old_pages = pages + HEADERLESS_PAGE_SIZE;
+  if (pread(fd, old_pages, file_length, 0) != file_length) {
+    printf("Error reading file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+
+  DatabaseHeader* header = pages;
+  memcpy(header->magic, DB_HEADER_MAGIC, sizeof(header->magic));
+  header->version = DB_HEADER_VERSION;
+  header->page_size = HEADERLESS_PAGE_SIZE;
+  header->root_page_num = 1;
+  header->num_pages = num_pages + 1;
+  header->freelist_head = 0;
+  strncpy(header->schema, DB_SCHEMA, SCHEMA_SIZE - 1);
+  header->flags = 0;
+  for (uint32_t i = 0; i < num_pages; i++) {
+    header->num_rows += upgrade_node(old_pages + i * HEADERLESS_PAGE_SIZE, num_pages);
+  }
+
+  // write the upgraded copy next to the database and swap it in.
+  char* temp_filename = malloc(strlen(filename) + sizeof("-upgrade"));
+  sprintf(temp_filename, "%s-upgrade", filename);
+  int temp_fd = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+  size_t length = (size_t)(num_pages + 1) * HEADERLESS_PAGE_SIZE;
+  if (temp_fd == -1 || write(temp_fd, pages, length) != (ssize_t)length || fsync(temp_fd) == -1) {
+    printf("Error writing upgraded db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  close(temp_fd);
+  free(pages);
+
+  if (rename(temp_filename, filename) == -1) {
+    printf("Error replacing db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  sync_directory(filename);
+  free(temp_filename);
+  printf("Upgraded database to version %d.\n", DB_HEADER_VERSION);
+}
@@ -0,0 +1,17 @@
+#ifndef upgrade_h
+#define upgrade_h
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// databases written before the file header existed have no header page:
+// 4096 byte pages with the root node in page 0.
+#define HEADERLESS_PAGE_SIZE 4096
+
+// true if the open file is a headerless database.
+bool is_headerless_database(int fd, off_t file_length);
+// rewrite a headerless database with a header in page 0 and every node one page down,
+// then atomically replace the file. the caller reopens it afterwards.
+void upgrade_headerless_database(const char* filename, int fd, off_t file_length);
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "vm.h"
+#include "pager.h"
+#include "btree.h"
+#include "vacuum.h"
+
+// the pages of a tree in the order they should be laid out in the file:
+// the root, the other internal nodes in preorder, then the leaves in key order.
+// every page is latched exclusively while it is listed.
+typedef struct {
+  uint32_t pages[TABLE_MAX_PAGES];
+  uint32_t num_pages;
+  // for every page number, the parent page and the slot of the parent that points to it.
+  uint32_t parent[TABLE_MAX_PAGES];
+  uint32_t child_index[TABLE_MAX_PAGES];
+} TreeLayout;
+
+static void collect_pages(Pager* pager, TreeLayout* layout, uint32_t page_num, bool leaves) {
+  void* node = get_page(pager, page_num);
+  if (get_node_type(node) == NODE_LEAF) {
+    if (leaves) {
+      layout->pages[layout->num_pages++] = page_num;
+    }
+    return;
+  }
+  if (!leaves) {
+    layout->pages[layout->num_pages++] = page_num;
+  }
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = 0; i <= num_keys; i++) {
+    uint32_t child_page_num = *internal_node_child(node, i);
+    layout->parent[child_page_num] = page_num;
+    layout->child_index[child_page_num] = i;
+    collect_pages(pager, layout, child_page_num, leaves);
+  }
+}
+
+// latch the whole tree top down, in the order readers and writers crab.
+static void latch_tree(Pager* pager, uint32_t page_num) {
+  pager_latch(pager, page_num, LATCH_EXCLUSIVE);
+  void* node = get_page(pager, page_num);
+  if (get_node_type(node) == NODE_INTERNAL) {
+    uint32_t num_keys = *internal_node_num_keys(node);
+    for (uint32_t i = 0; i <= num_keys; i++) {
+      latch_tree(pager, *internal_node_child(node, i));
+    }
+  }
+}
+
+// take the writer lock and latch every page so nothing else touches the tree.
+static void lock_tree(Table* table, TreeLayout* layout) {
+  pthread_mutex_lock(&table->writer_lock);
+  latch_tree(table->pager, table->root_page_num);
+
+  layout->num_pages = 0;
+  collect_pages(table->pager, layout, table->root_page_num, false);
+  collect_pages(table->pager, layout, table->root_page_num, true);
+}
+
+static void unlock_tree(Table* table, TreeLayout* layout) {
+  for (uint32_t i = 0; i < layout->num_pages; i++) {
+    pager_unlatch(table->pager, layout->pages[i]);
+  }
+  pthread_mutex_unlock(&table->writer_lock);
+}
+
+// full vacuum
+
+// fill the empty table copy with the leaf cells of the layout, packing leaves in key order
+// up to VACUUM_LEAF_FREE_CELLS short of full.
+static void write_packed_tree(Table* table, TreeLayout* layout, Table* copy) {
+  Pager* pager = table->pager;
+  uint32_t max_cells = leaf_node_max_cells(pager->page_size);
+  uint32_t fill_cells = max_cells - VACUUM_LEAF_FREE_CELLS;
+  // the copy was created with the table's layout. the root cannot tell once it is internal.
+  LeafLayout leaf_layout = (copy->pager->header.flags & DB_FLAG_PAX_LEAVES) ? LEAF_LAYOUT_PAX : LEAF_LAYOUT_ROW;
+
+  uint32_t total_cells = 0;
+  for (uint32_t i = 0; i < layout->num_pages; i++) {
+    void* node = get_page(pager, layout->pages[i]);
+    if (get_node_type(node) == NODE_LEAF) {
+      total_cells += *leaf_node_num_cells(node);
+    }
+  }
+
+  // a single leaf is the root itself and can still split, otherwise the root points at every leaf.
+  void* root = get_page(copy->pager, copy->root_page_num);
+  uint32_t num_leaves = total_cells <= max_cells ? 1 : (total_cells + fill_cells - 1) / fill_cells;
+  if (num_leaves > 1) {
+    if (num_leaves - 1 > internal_node_max_cells(pager->page_size)) {
+      printf("Need to implement vacuuming trees deeper than two levels\n");
+      exit(EXIT_FAILURE);
+    }
+    initialize_internal_node(root);
+    set_node_root(root, true);
+  }
+
+  void* destination = root;
+  uint32_t destination_page_num = copy->root_page_num;
+  uint32_t num_leaves_written = 0;
+  for (uint32_t i = 0; i < layout->num_pages; i++) {
+    void* source = get_page(pager, layout->pages[i]);
+    if (get_node_type(source) != NODE_LEAF) {
+      continue;
+    }
+    uint32_t num_cells = *leaf_node_num_cells(source);
+    for (uint32_t cell_num = 0; cell_num < num_cells; cell_num++) {
+      if (destination == root && num_leaves > 1) {
+        // start the next leaf on the next page.
+        destination_page_num = get_unused_page_num(copy->pager);
+        destination = get_page(copy->pager, destination_page_num);
+        initialize_leaf_node(destination, leaf_layout, pager->page_size);
+      }
+      uint32_t* destination_num_cells = leaf_node_num_cells(destination);
+      leaf_node_copy_cell(destination, *destination_num_cells, source, cell_num);
+      *destination_num_cells += 1;
+
+      if (*destination_num_cells == fill_cells && num_leaves > 1) {
+        // leaf is full, link it into the root.
+        num_leaves_written += 1;
+        if (num_leaves_written < num_leaves) {
+          uint32_t key_num = *internal_node_num_keys(root);
+          *internal_node_num_keys(root) = key_num + 1;
+          *internal_node_child(root, key_num) = destination_page_num;
+          *internal_node_key(root, key_num) = get_node_max_key(destination);
+        } else {
+          *internal_node_right_child(root) = destination_page_num;
+        }
+        destination = root;
+      }
+    }
+  }
+  // the last leaf may be partially filled.
+  if (destination != root) {
+    *internal_node_right_child(root) = destination_page_num;
+  }
+}
+
+void vacuum(Table* table) {
+  TreeLayout layout;
+  lock_tree(table, &layout);
+  Pager* pager = table->pager;
+
+  // build the compacted copy next to the database.
+  char* temp_filename = malloc(strlen(pager->filename) + sizeof("-vacuum"));
+  sprintf(temp_filename, "%s-vacuum", pager->filename);
+  unlink(temp_filename);
+
+  CreateOptions options = {
+    pager->page_size,
+    (pager->header.flags & DB_FLAG_COMPRESSED) != 0,
+    (pager->header.flags & DB_FLAG_PAX_LEAVES) ? LEAF_LAYOUT_PAX : LEAF_LAYOUT_ROW,
+  };
+  Table* copy = db_open(temp_filename, &options);
+  write_packed_tree(table, &layout, copy);
+  copy->pager->header.num_rows = pager->header.num_rows;
+  db_close(copy);
+
+  // swap it in. readers are waiting on the root latch and see the new file next.
+  if (rename(temp_filename, pager->filename) == -1) {
+    printf("Error replacing db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  sync_directory(pager->filename);
+  free(temp_filename);
+
+  pager_reopen(pager);
+  table->root_page_num = pager->header.root_page_num;
+  unlock_tree(table, &layout);
+}
+
+// incremental vacuum
+
+// exchange pages a and b, fixing the child pointers of their parents and the layout.
+static void swap_pages(Table* table, TreeLayout* layout, uint32_t a, uint32_t b) {
+  Pager* pager = table->pager;
+
+  // point the parents at the new locations before the contents move,
+  // so the update travels along if a parent is itself one of the two pages.
+  void* parent_of_a = get_page(pager, layout->parent[a]);
+  *internal_node_child(parent_of_a, layout->child_index[a]) = b;
+  void* parent_of_b = get_page(pager, layout->parent[b]);
+  *internal_node_child(parent_of_b, layout->child_index[b]) = a;
+
+  pager_swap_pages(pager, a, b);
+
+  // renumber the layout the same way.
+  uint32_t parent[TABLE_MAX_PAGES];
+  uint32_t child_index[TABLE_MAX_PAGES];
+  memcpy(parent, layout->parent, sizeof(parent));
+  memcpy(child_index, layout->child_index, sizeof(child_index));
+  for (uint32_t i = 0; i < layout->num_pages; i++) {
+    uint32_t old_page_num = layout->pages[i];
+    uint32_t new_page_num = old_page_num == a ? b : (old_page_num == b ? a : old_page_num);
+    uint32_t old_parent = parent[old_page_num];
+    layout->pages[i] = new_page_num;
+    layout->parent[new_page_num] = old_parent == a ? b : (old_parent == b ? a : old_parent);
+    layout->child_index[new_page_num] = child_index[old_page_num];
+  }
+}
+
+uint32_t vacuum_incremental(Table* table, uint32_t max_pages) {
+  TreeLayout layout;
+  lock_tree(table, &layout);
+
+  // every page after the root belongs to the tree, so the layout is a permutation of them.
+  uint32_t num_pages_moved = 0;
+  if (layout.num_pages == table->pager->num_pages - table->root_page_num) {
+    for (uint32_t i = 1; i < layout.num_pages && num_pages_moved < max_pages; i++) {
+      uint32_t target_page_num = table->root_page_num + i;
+      if (layout.pages[i] != target_page_num) {
+        swap_pages(table, &layout, layout.pages[i], target_page_num);
+        num_pages_moved += 1;
+      }
+    }
+  }
+
+  unlock_tree(table, &layout);
+  return num_pages_moved;
+}
@@ -0,0 +1,16 @@
+#ifndef vacuum_h
+#define vacuum_h
+
+#include "common.h"
+
+// cells left free in every packed leaf, so the first inserts after a vacuum do not split.
+#define VACUUM_LEAF_FREE_CELLS 1
+
+// rewrite the table into a fresh file with densely packed leaves laid out
+// in key order right after the root, then atomically replace the database.
+void vacuum(Table* table);
+// move at most max_pages pages to their key order position in place.
+// returns the number of pages moved.
+uint32_t vacuum_incremental(Table* table, uint32_t max_pages);
+
+#endif
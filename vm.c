@@ -8,39 +8,89 @@
 #include "vm.h"
 #include "pager.h"
 #include "btree.h"
+#include "stats.h"
+#include "vacuum.h"
+#include "arena.h"
 
 // serialization
 
-static void serialize_row(Row* source, void* destination) {
-  memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
-  strncpy(destination + USERNAME_OFFSET, source->username, USERNAME_SIZE);
-  strncpy(destination + EMAIL_OFFSET, source->email, EMAIL_SIZE);
+// rows are read and written field by field so either leaf layout works.
+
+static void serialize_row(Row* source, void* node, uint32_t cell_num) {
+  memcpy(leaf_node_id(node, cell_num), &(source->id), ID_SIZE);
+  strncpy(leaf_node_username(node, cell_num), source->username, USERNAME_SIZE);
+  strncpy(leaf_node_email(node, cell_num), source->email, EMAIL_SIZE);
+  stats_add(bytes_serialized, ROW_SIZE);
 }
 
-static void deserialize_row(void *source, Row* destination) {
-  memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-  memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
-  memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+static void deserialize_row(void* node, uint32_t cell_num, Row* destination) {
+  memcpy(&(destination->id), leaf_node_id(node, cell_num), ID_SIZE);
+  memcpy(&(destination->username), leaf_node_username(node, cell_num), USERNAME_SIZE);
+  memcpy(&(destination->email), leaf_node_email(node, cell_num), EMAIL_SIZE);
 }
 
-// create a cursor at the beginning of the table.
-static Cursor* table_start(Table* table) {
-    Cursor* cursor = malloc(sizeof(Cursor));
-    cursor->table = table;
-    cursor->page_num = table->root_page_num;
-    cursor->cell_num = 0;
+// layout for new leaves of this table.
+static LeafLayout table_leaf_layout(Table* table) {
+  return (table->pager->header.flags & DB_FLAG_PAX_LEAVES) ? LEAF_LAYOUT_PAX : LEAF_LAYOUT_ROW;
+}
 
-    // get number of cells in the table root node.
-    void* root_node = get_page(table->pager, table->root_page_num);
-    uint32_t num_cells = *leaf_node_num_cells(root_node);
-    cursor->end_of_table = (num_cells == 0);
+// cursors
 
-    return cursor;
+static void cursor_init(Cursor* cursor, Table* table, LatchMode latch_mode) {
+  cursor->table = table;
+  cursor->page_num = table->root_page_num;
+  cursor->cell_num = 0;
+  cursor->end_of_table = false;
+  cursor->latch_mode = latch_mode;
+  cursor->num_latched = 0;
+  cursor->snapshot = NULL;
+}
+
+// latch a page in the cursor's mode and remember it for release.
+static void cursor_latch(Cursor* cursor, uint32_t page_num) {
+  if (cursor->latch_mode == LATCH_NONE) {
+    return;
+  }
+  if (cursor->num_latched >= CURSOR_MAX_DEPTH) {
+    printf("Tree is too deep to latch\n");
+    exit(EXIT_FAILURE);
+  }
+  pager_latch(cursor->table->pager, page_num, cursor->latch_mode);
+  cursor->latched_pages[cursor->num_latched] = page_num;
+  cursor->num_latched += 1;
+}
+
+// release every latch except the one on the most recently latched page.
+static void cursor_release_ancestors(Cursor* cursor) {
+  if (cursor->num_latched <= 1) {
+    return;
+  }
+  for (uint32_t i = 0; i + 1 < cursor->num_latched; i++) {
+    pager_unlatch(cursor->table->pager, cursor->latched_pages[i]);
+  }
+  cursor->latched_pages[0] = cursor->latched_pages[cursor->num_latched - 1];
+  cursor->num_latched = 1;
+}
+
+static void close_cursor(Cursor* cursor) {
+  for (uint32_t i = 0; i < cursor->num_latched; i++) {
+    pager_unlatch(cursor->table->pager, cursor->latched_pages[i]);
+  }
+  cursor->num_latched = 0;
+}
+
+// return the node the cursor points into.
+static void* cursor_node(Cursor* cursor) {
+  if (cursor->snapshot != NULL) {
+    return cursor->snapshot;
+  }
+  return get_page(cursor->table->pager, cursor->page_num);
 }
 
 // btree
 
 static void create_new_root(Table* table, uint32_t right_child_page_num) {
+  stats_add(root_splits, 1);
   void* root = get_page(table->pager, table->root_page_num);
   void* right_child = get_page(table->pager, right_child_page_num);
   // create new page for left child (old root)
@@ -48,7 +98,7 @@ static void create_new_root(Table* table, uint32_t right_child_page_num) {
   void* left_child = get_page(table->pager, left_child_page_num);
 
   // copy data from old root to left child.
-  memcpy(left_child, root, PAGE_SIZE);
+  memcpy(left_child, root, table->pager->page_size);
   set_node_root(left_child, false);
 
   // initialize root page.
@@ -61,46 +111,82 @@ static void create_new_root(Table* table, uint32_t right_child_page_num) {
   *internal_node_right_child(root) = right_child_page_num;
 }
 
+// link new_page_num into its parent right after old_page_num, the child it was split from.
+// separators are the largest key of their child, so the new page takes over the old
+// separator and the old page gets its new maximum.
+static void internal_node_insert_split(Table* table, uint32_t parent_page_num, uint32_t old_page_num, uint32_t new_page_num) {
+  void* parent = get_page(table->pager, parent_page_num);
+  void* old_node = get_page(table->pager, old_page_num);
+  uint32_t num_keys = *internal_node_num_keys(parent);
+  // grow first, a child index equal to the key count addresses the right child.
+  *internal_node_num_keys(parent) = num_keys + 1;
+
+  if (*internal_node_right_child(parent) == old_page_num) {
+    // the old page moves into the cells and the new page becomes the right child.
+    *internal_node_child(parent, num_keys) = old_page_num;
+    *internal_node_key(parent, num_keys) = get_node_max_key(old_node);
+    *internal_node_right_child(parent) = new_page_num;
+    return;
+  }
+
+  uint32_t index = 0;
+  while (*internal_node_child(parent, index) != old_page_num) {
+    index++;
+  }
+  // shift the cells after the old page one space to the right.
+  for (uint32_t i = num_keys; i > index + 1; i--) {
+    *internal_node_child(parent, i) = *internal_node_child(parent, i - 1);
+    *internal_node_key(parent, i) = *internal_node_key(parent, i - 1);
+  }
+  *internal_node_child(parent, index + 1) = new_page_num;
+  *internal_node_key(parent, index + 1) = *internal_node_key(parent, index);
+  *internal_node_key(parent, index) = get_node_max_key(old_node);
+}
+
 static void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value) {
+  stats_add(leaf_splits, 1);
+  uint32_t page_size = cursor->table->pager->page_size;
+  uint32_t left_split_count = leaf_node_left_split_count(page_size);
   // get old node
   void* old_node = get_page(cursor->table->pager, cursor->page_num);
   // get new node
   uint32_t new_page_num = get_unused_page_num(cursor->table->pager);
   void* new_node = get_page(cursor->table->pager, new_page_num);
-  initialize_leaf_node(new_node);
+  initialize_leaf_node(new_node, get_leaf_layout(old_node), page_size);
 
   // split cells between two nodes
-  for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--) {
+  for (int32_t i = leaf_node_max_cells(page_size); i >= 0; i--) {
     void* destination_node;
-    if (i >= LEAF_NODE_LEFT_SPLIT_COUNT) {
+    if (i >= left_split_count) {
       destination_node = new_node;
     } else {
       destination_node = old_node;
     }
     // destination cell
-    uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-    void* destination = leaf_node_cell(destination_node, index_within_node);
+    uint32_t index_within_node = i % left_split_count;
 
     if (i == cursor->cell_num) {
-      serialize_row(value, destination);
+      *leaf_node_key(destination_node, index_within_node) = key;
+      serialize_row(value, destination_node, index_within_node);
     } else if (i > cursor->cell_num) {
-      memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
-    } else {
-      memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
+      leaf_node_copy_cell(destination_node, index_within_node, old_node, i - 1);
+    } else if (destination_node != old_node) {
+      leaf_node_copy_cell(destination_node, index_within_node, old_node, i);
     }
   }
 
   // update cell count
-  *leaf_node_num_cells(old_node) = LEAF_NODE_LEFT_SPLIT_COUNT;
-  *leaf_node_num_cells(new_node) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+  *leaf_node_num_cells(old_node) = left_split_count;
+  *leaf_node_num_cells(new_node) = leaf_node_right_split_count(page_size);
 
   // update parent
   if (is_node_root(old_node)) {
     // handle splitting root by creating new root.
     return create_new_root(cursor->table, new_page_num);
   } else {
-    printf("Need to implement updating parent after split\n");
-    exit(EXIT_FAILURE);
+    // the writer kept the parent latched because the leaf was full.
+    uint32_t parent_page_num = cursor->latched_pages[cursor->num_latched - 2];
+    internal_node_insert_split(cursor->table, parent_page_num, cursor->page_num, new_page_num);
   }
 } 
 
@@ -108,35 +194,25 @@ static void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value) {
     void* node = get_page(cursor->table->pager, cursor->page_num);
 
     uint32_t num_cells = *leaf_node_num_cells(node);
-    if (num_cells >= LEAF_NODE_MAX_CELLS) {
+    if (num_cells >= leaf_node_max_cells(cursor->table->pager->page_size)) {
         leaf_node_split_and_insert(cursor, key, value);
         return;
     }
 
     if (cursor->cell_num < num_cells) {
         // shift cell one space to the right to make room for new cell.
-        for (uint32_t i = num_cells; i > cursor->cell_num; i--) {
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
-        }
+        leaf_node_shift_cells(node, cursor->cell_num);
     }
 
     *(leaf_node_num_cells(node)) += 1;
     *(leaf_node_key(node, cursor->cell_num)) = key;
-    serialize_row(value, leaf_node_value(node, cursor->cell_num));
+    serialize_row(value, node, cursor->cell_num);
 }
 
-static Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
-  void* node = get_page(table->pager, page_num);
-  if (get_node_type(node) == NODE_INTERNAL) {
-    printf("Need to implement searching an internal node\n");
-  }
+static void leaf_node_find(Cursor* cursor, uint32_t key) {
+  void* node = get_page(cursor->table->pager, cursor->page_num);
   uint32_t num_cells = *leaf_node_num_cells(node);
 
-  // create cursor
-  Cursor* cursor = malloc(sizeof(Cursor));
-  cursor->table = table;
-  cursor->page_num = page_num;
-
   // binary search
   uint32_t min_index = 0;
   uint32_t max_index = num_cells;
@@ -145,7 +221,7 @@ static Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
     uint32_t key_at_index = *leaf_node_key(node, index);
     if (key_at_index == key) {
       cursor->cell_num = index;
-      return cursor;
+      return;
     }
     if (key_at_index > key) {
       max_index = index;
@@ -155,12 +231,10 @@ static Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
   }
 
   cursor->cell_num = min_index;
-  
-  return cursor;
 }
 
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key) {
-  void* node = get_page(table->pager, page_num);
+// return the index of the child which should contain the key.
+static uint32_t internal_node_find_child(void* node, uint32_t key) {
   uint32_t num_keys = *internal_node_num_keys(node);
 
   // find index of child to search with binary search.
@@ -170,92 +244,192 @@ Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key) {
   while (min_index < max_index) {
     uint32_t index = (min_index + max_index) / 2;
     uint32_t key_to_right = *internal_node_key(node, index);
-    if (key_to_right > key) {
+    if (key_to_right >= key) {
       max_index = index;
     } else {
       min_index = index + 1;
     }
   }
 
-  // recursively search child.
-  uint32_t child_num = *internal_node_child(node, min_index);
-  void* child = get_page(table->pager, child_num);
-  if (get_node_type(child) == NODE_INTERNAL) {
-    return internal_node_find(table, child_num, key);
-  } else {
-    return leaf_node_find(table, child_num, key);
+  return min_index;
+}
+
+// a node is safe when an insert below it cannot split it.
+static bool is_node_safe(void* node, uint32_t page_size) {
+  switch (get_node_type(node)) {
+    case NODE_INTERNAL:
+      return *internal_node_num_keys(node) + 1 < internal_node_max_cells(page_size);
+    case NODE_LEAF:
+      return *leaf_node_num_cells(node) < leaf_node_max_cells(page_size);
+    default:
+      return false;
   }
 }
 
-// create a cursor at the position to insert key in the table.
-static Cursor* table_find(Table* table, uint32_t key) {
+// position a cursor at the place to insert key in the table.
+// latches are crabbed down the tree: a child is latched before its parent is released.
+// readers release the parent right away, a writer only once the child is safe.
+// the cursor keeps its latches until it is closed.
+static void table_find(Table* table, uint32_t key, LatchMode latch_mode, Cursor* cursor) {
+  cursor_init(cursor, table, latch_mode);
+
   // get table root node.
-  uint32_t root_page_num = table->root_page_num;
-  void* root_node = get_page(table->pager, root_page_num);
+  uint32_t page_num = table->root_page_num;
+  cursor_latch(cursor, page_num);
+  void* node = get_page(table->pager, page_num);
 
-  // check node type.
-  if (get_node_type(root_node) == NODE_LEAF) {
-    return leaf_node_find(table, root_page_num, key);
-  } else {
-    return internal_node_find(table, root_page_num, key);
+  // descend until a leaf is reached.
+  while (get_node_type(node) == NODE_INTERNAL) {
+    uint32_t child_index = internal_node_find_child(node, key);
+    page_num = *internal_node_child(node, child_index);
+    cursor_latch(cursor, page_num);
+    node = get_page(table->pager, page_num);
+    if (latch_mode != LATCH_EXCLUSIVE || is_node_safe(node, table->pager->page_size)) {
+      cursor_release_ancestors(cursor);
+    }
   }
+
+  cursor->page_num = page_num;
+  leaf_node_find(cursor, key);
+}
+
+// copy the leaf holding key, or the next larger key, into the cursor's snapshot
+// and position the cursor there. the leaf is only latched while it is copied.
+static void cursor_load_leaf(Cursor* cursor, uint32_t key) {
+  Pager* pager = cursor->table->pager;
+  Cursor leaf;
+  table_find(cursor->table, key, LATCH_SHARED, &leaf);
+  memcpy(cursor->snapshot, get_page(pager, leaf.page_num), pager->page_size);
+  cursor->page_num = leaf.page_num;
+  cursor->cell_num = leaf.cell_num;
+  close_cursor(&leaf);
+
+  // separators are the largest key of their subtree, so a leaf without a larger key
+  // is the rightmost one.
+  cursor->end_of_table = cursor->cell_num >= *leaf_node_num_cells(cursor->snapshot);
+}
+
+// position a cursor at the beginning of the table.
+// the cursor reads from a copy of one leaf at a time, so no latches are held while
+// rows are consumed and a writer is only kept out of a leaf while it is copied.
+// the copy is allocated from arena and is valid until the arena is reset.
+static void table_start(Table* table, Arena* arena, Cursor* cursor) {
+  cursor_init(cursor, table, LATCH_NONE);
+  cursor->snapshot = arena_alloc(arena, table->pager->page_size);
+  cursor_load_leaf(cursor, 0);
 }
 
 static void cursor_advance(Cursor* cursor) {
-  uint32_t page_num = cursor->page_num;
-  void* node = get_page(cursor->table->pager, page_num);
+  void* node = cursor_node(cursor);
 
   cursor->cell_num += 1;
   
-  if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
-    cursor->end_of_table = true;
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  if (cursor->cell_num >= num_cells) {
+    // a scan looks up the leaf after the last key it returned, wherever splits have moved it.
+    uint32_t last_key = *leaf_node_key(node, num_cells - 1);
+    if (cursor->snapshot != NULL && last_key != UINT32_MAX) {
+      cursor_load_leaf(cursor, last_key + 1);
+    } else {
+      cursor->end_of_table = true;
+    }
   }
 }
 
-// return a pointer to the position in page described by the cursor.
-static void* cursor_value(Cursor* cursor) {
-  uint32_t page_num = cursor->page_num;
-  void* page = get_page(cursor->table->pager, page_num);
-  return leaf_node_value(page, cursor->cell_num);
+// read the row at the position described by the cursor.
+static void cursor_read_row(Cursor* cursor, Row* row) {
+  deserialize_row(cursor_node(cursor), cursor->cell_num, row);
+}
+
+// a full leaf needs a free page to split into, the root two, and a slot in its parent.
+// internal nodes cannot split yet, so a full parent also means the table is full.
+static bool has_room_for_insert(Cursor* cursor) {
+  Pager* pager = cursor->table->pager;
+  void* node = get_page(pager, cursor->page_num);
+  if (*leaf_node_num_cells(node) < leaf_node_max_cells(pager->page_size)) {
+    return true;
+  }
+  uint32_t num_pages = get_unused_page_num(pager);
+  if (is_node_root(node)) {
+    return num_pages + 2 <= TABLE_MAX_PAGES;
+  }
+  void* parent = get_page(pager, cursor->latched_pages[cursor->num_latched - 2]);
+  return num_pages + 1 <= TABLE_MAX_PAGES &&
+      *internal_node_num_keys(parent) < internal_node_max_cells(pager->page_size);
 }
 
 // statement execution
 
 static ExecuteResult execute_insert(Statement* statement, Table* table) {
-  void* node = get_page(table->pager, table->root_page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
+  // only one writer at a time.
+  pthread_mutex_lock(&table->writer_lock);
 
   Row* row_to_insert = &(statement->row_to_insert);
   // search table for place to insert.
   uint32_t key_to_insert = row_to_insert->id;
-  Cursor* cursor = table_find(table, key_to_insert);
+  Cursor cursor;
+  table_find(table, key_to_insert, LATCH_EXCLUSIVE, &cursor);
 
-  if (cursor->cell_num < num_cells) {
-    // check if key already exists
-    uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
-    if (key_at_index == key_to_insert) {
-      return EXECUTE_DUPLICATE_KEY;
-    }
+  void* node = get_page(table->pager, cursor.page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node);
+
+  ExecuteResult result = EXECUTE_SUCCESS;
+  if (cursor.cell_num < num_cells && *leaf_node_key(node, cursor.cell_num) == key_to_insert) {
+    // key already exists
+    result = EXECUTE_DUPLICATE_KEY;
+  } else if (!has_room_for_insert(&cursor)) {
+    result = EXECUTE_TABLE_FULL;
+  } else {
+    leaf_node_insert(&cursor, row_to_insert->id, row_to_insert);
+    table->pager->header.num_rows += 1;
   }
-  
-  leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
 
-  free(cursor);
+  close_cursor(&cursor);
+  pthread_mutex_unlock(&table->writer_lock);
 
-  return EXECUTE_SUCCESS;
+  return result;
+}
+
+// look up a single row by key. returns false if the key is absent.
+bool find_row(Table* table, uint32_t key, Row* row) {
+  Cursor cursor;
+  table_find(table, key, LATCH_SHARED, &cursor);
+  void* node = get_page(table->pager, cursor.page_num);
+
+  bool found = cursor.cell_num < *leaf_node_num_cells(node) &&
+      *leaf_node_key(node, cursor.cell_num) == key;
+  if (found) {
+    cursor_read_row(&cursor, row);
+  }
+
+  close_cursor(&cursor);
+  return found;
 }
 
-static void print_row(Row* row) {
+void print_row(Row* row, void* context) {
   printf("(%d, %s, %s)\n", row->id, row->username, row->email);
 }
 
-static void print_constants() {
+static void print_constants(uint32_t page_size) {
   printf("ROW_SIZE: %d\n", ROW_SIZE);
   printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
   printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
   printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
-  printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELLS);
-  printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
+  printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", leaf_node_space_for_cells(page_size));
+  printf("LEAF_NODE_MAX_CELLS: %d\n", leaf_node_max_cells(page_size));
+}
+
+static void print_database_info(Table* table) {
+  DatabaseHeader* header = &table->pager->header;
+  printf("version: %d\n", header->version);
+  printf("page_size: %d\n", header->page_size);
+  printf("root_page_num: %d\n", table->root_page_num);
+  printf("num_pages: %d\n", table->pager->num_pages);
+  printf("freelist_head: %d\n", header->freelist_head);
+  printf("num_rows: %lu\n", header->num_rows);
+  printf("compressed: %s\n", (header->flags & DB_FLAG_COMPRESSED) ? "yes" : "no");
+  printf("leaf_layout: %s\n", table_leaf_layout(table) == LEAF_LAYOUT_PAX ? "pax" : "row");
+  printf("schema: %s\n", header->schema);
 }
 
 void indent(uint32_t level) {
@@ -295,36 +469,71 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
   }
 }
 
-static ExecuteResult execute_select(Statement* statement, Table* table) {
+static ExecuteResult execute_select(Statement* statement, Table* table, RowHandler handle_row, void* context) {
   // open a cursor at the start of the table for select.
-  Cursor* cursor = table_start(table);
+  Cursor cursor;
+  table_start(table, statement->arena, &cursor);
 
   Row row;
-  while (!(cursor->end_of_table)) {
-    deserialize_row(cursor_value(cursor), &row);
-    print_row(&row);
-    cursor_advance(cursor);
+  while (!(cursor.end_of_table)) {
+    cursor_read_row(&cursor, &row);
+    handle_row(&row, context);
+    cursor_advance(&cursor);
   }
 
-  free(cursor);
+  close_cursor(&cursor);
 
   return EXECUTE_SUCCESS;
 }
 
+// open a connection to the database.
+// creation options only apply if the file does not exist yet.
+Table* db_open(const char* filename, CreateOptions* options) {
+  // open database file
+  // initialize pager data structure
+  Pager* pager = pager_open(filename, options);
+  // initialize table data structure
+  Table* table = (Table*)malloc(sizeof(Table));
+  table->pager = pager;
+  table->root_page_num = pager->header.root_page_num;
+  pthread_mutex_init(&table->writer_lock, NULL);
+  table->timer = false;
+
+  if (table->root_page_num == 0) {
+    // new database: intialize root page as leaf node.
+    table->root_page_num = get_unused_page_num(pager);
+    pager->header.root_page_num = table->root_page_num;
+    void* root_node = get_page(pager, table->root_page_num);
+    initialize_leaf_node(root_node, table_leaf_layout(table), pager->page_size);
+    set_node_root(root_node, true);
+  }
+
+  return table;
+}
+
 // flush cache to disk when database connection is closed.
 void db_close(Table* table) {
   Pager* pager = table->pager;
   
-  // flush full pages and free memory.
+  // flush full pages.
   for (uint32_t i = 0; i < pager->num_pages; i++) {
     if (pager->pages[i] == NULL) {
       continue;
     }
     pager_flush(pager, i);
-    free(pager->pages[i]);
     pager->pages[i] = NULL;
   }
 
+  pager->header.root_page_num = table->root_page_num;
+  pager_write_header(pager);
+
+  // make the flushed pages durable.
+  if (fsync(pager->file_descriptor) == -1) {
+    printf("Error syncing db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  stats_add(fsyncs, 1);
+
   // close some db file.
   int result = close(pager->file_descriptor);
   if (result == -1) {
@@ -332,14 +541,14 @@ void db_close(Table* table) {
     exit(EXIT_FAILURE);
   }
 
-  // free some pages just in case.
   for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    void* page = pager->pages[i];
-    if (page) {
-      free(page);
-      pager->pages[i] = NULL;
-    }
+    pthread_rwlock_destroy(&pager->latches[i]);
   }
+  free(pager->frames);
+  pthread_mutex_destroy(&pager->lock);
+  pthread_mutex_destroy(&table->writer_lock);
+  free(pager->compression_buffer);
+  free(pager->filename);
   free(pager);
   free(table);
 }
@@ -351,22 +560,46 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table *table) {
     exit(EXIT_SUCCESS);
   } else if (strcmp(input_buffer->buffer, ".btree") == 0) {
     printf("Tree:\n");
-    print_tree(table->pager, 0, 0);
+    print_tree(table->pager, table->root_page_num, 0);
     return META_COMMAND_SUCCESS;
   } else if (strcmp(input_buffer->buffer, ".constants") == 0) {
     printf("Constants:\n");
-    print_constants();
+    print_constants(table->pager->page_size);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".dbinfo") == 0) {
+    printf("Database:\n");
+    print_database_info(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".vacuum") == 0) {
+    vacuum(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strncmp(input_buffer->buffer, ".vacuum incremental ", 20) == 0) {
+    uint32_t max_pages = atoi(input_buffer->buffer + 20);
+    printf("Pages relocated: %d\n", vacuum_incremental(table, max_pages));
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".stats") == 0) {
+    printf("Stats:\n");
+    print_stats();
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".stats reset") == 0) {
+    stats_reset();
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".timer on") == 0) {
+    table->timer = true;
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".timer off") == 0) {
+    table->timer = false;
     return META_COMMAND_SUCCESS;
   } else {
     return META_COMMAND_UNRECOGNIZED_COMMAND;
   }
 }
 
-ExecuteResult execute_statement(Statement* statement, Table* table) {
+ExecuteResult execute_statement(Statement* statement, Table* table, RowHandler handle_row, void* context) {
   switch (statement->type) {
     case (STATEMENT_INSERT):
       return execute_insert(statement, table);
     case (STATEMENT_SELECT):
-      return execute_select(statement, table);
+      return execute_select(statement, table, handle_row, context);
   }
 }
\ No newline at end of file
@@ -8,7 +8,15 @@ typedef enum {
   META_COMMAND_UNRECOGNIZED_COMMAND
 } MetaCommandResult;
 
+// receives each row produced by a select.
+typedef void (*RowHandler)(Row* row, void* context);
+
+Table* db_open(const char* filename, CreateOptions* options);
+void db_close(Table* table);
 MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table *table);
-ExecuteResult execute_statement(Statement* statement, Table* table);
+ExecuteResult execute_statement(Statement* statement, Table* table, RowHandler handle_row, void* context);
+bool find_row(Table* table, uint32_t key, Row* row);
+// row handler that prints rows to stdout.
+void print_row(Row* row, void* context);
 
 #endif
\ No newline at end of file